@@ -0,0 +1,138 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <zlib.h>
+#include "AlertClip.h"
+
+static const uint32_t CLIP_MAGIC = 0x4C434354; // "TCCL"
+static const uint16_t CLIP_VERSION = 1;
+static const size_t CLIP_HEADER_SIZE = 32;
+static const size_t PIXELS = SENSOR_W * SENSOR_H;
+static const size_t FRAME_SIZE = 28 + PIXELS * 2;
+// Temperatures are stored in steps of 1 / TEMP_SCALE degrees
+static const float TEMP_SCALE = 100.0f;
+static const uint32_t FLAG_MEASURING = 1;
+
+bool save_alert_clip(const std::vector<Measurement> &frames, size_t trigger, const std::string &path) {
+    std::vector<uint8_t> raw(frames.size() * FRAME_SIZE);
+    uint16_t previous[PIXELS] = {};
+    for (size_t f = 0; f < frames.size(); f++) {
+        const Measurement &frame = frames[f];
+        uint8_t *record = raw.data() + f * FRAME_SIZE;
+        const uint32_t flags = frame.is_measuring ? FLAG_MEASURING : 0;
+        memcpy(record, &frame.frame_no, 8);
+        memcpy(record + 8, &frame.time_ms, 8);
+        memcpy(record + 16, &frame.ambient_temp, 4);
+        memcpy(record + 20, &frame.mean_temp_lpf, 4);
+        memcpy(record + 24, &flags, 4);
+        for (size_t i = 0; i < PIXELS; i++) {
+            // Differences wrap around in 16 bits, undone the same way when loading
+            const auto value = static_cast<uint16_t>(static_cast<int16_t>(
+                    std::lround(std::fmax(-327.0f, std::fmin(327.0f, frame.temperatures[i])) * TEMP_SCALE)));
+            const auto delta = static_cast<uint16_t>(value - previous[i]);
+            memcpy(record + 28 + i * 2, &delta, 2);
+            previous[i] = value;
+        }
+    }
+    uLongf compressed_size = compressBound(raw.size());
+    std::vector<uint8_t> compressed(compressed_size);
+    if (compress2(compressed.data(), &compressed_size, raw.data(), raw.size(), Z_BEST_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    uint8_t header[CLIP_HEADER_SIZE] = {};
+    const uint16_t width = SENSOR_W;
+    const uint16_t height = SENSOR_H;
+    const auto count = static_cast<uint32_t>(frames.size());
+    const auto trigger_index = static_cast<uint32_t>(trigger);
+    const auto raw_size = static_cast<uint32_t>(raw.size());
+    const auto payload_size = static_cast<uint32_t>(compressed_size);
+    const uint32_t crc = crc32(0L, compressed.data(), compressed_size);
+    memcpy(header, &CLIP_MAGIC, 4);
+    memcpy(header + 4, &CLIP_VERSION, 2);
+    memcpy(header + 6, &width, 2);
+    memcpy(header + 8, &height, 2);
+    memcpy(header + 12, &count, 4);
+    memcpy(header + 16, &trigger_index, 4);
+    memcpy(header + 20, &raw_size, 4);
+    memcpy(header + 24, &payload_size, 4);
+    memcpy(header + 28, &crc, 4);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = fwrite(header, 1, CLIP_HEADER_SIZE, file) == CLIP_HEADER_SIZE &&
+                         fwrite(compressed.data(), 1, compressed_size, file) == compressed_size;
+    return fclose(file) == 0 && written;
+}
+
+bool load_alert_clip(const std::string &path, std::vector<Measurement> &frames, size_t &trigger) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t header[CLIP_HEADER_SIZE];
+    uint32_t magic = 0, count = 0, trigger_index = 0, raw_size = 0, payload_size = 0, crc = 0;
+    uint16_t version = 0, width = 0, height = 0;
+    if (fread(header, 1, CLIP_HEADER_SIZE, file) == CLIP_HEADER_SIZE) {
+        memcpy(&magic, header, 4);
+        memcpy(&version, header + 4, 2);
+        memcpy(&width, header + 6, 2);
+        memcpy(&height, header + 8, 2);
+        memcpy(&count, header + 12, 4);
+        memcpy(&trigger_index, header + 16, 4);
+        memcpy(&raw_size, header + 20, 4);
+        memcpy(&payload_size, header + 24, 4);
+        memcpy(&crc, header + 28, 4);
+    }
+    if (magic != CLIP_MAGIC || version != CLIP_VERSION || width != SENSOR_W || height != SENSOR_H ||
+        raw_size != count * FRAME_SIZE) {
+        fclose(file);
+        return false;
+    }
+    std::vector<uint8_t> compressed(payload_size);
+    const bool complete = fread(compressed.data(), 1, payload_size, file) == payload_size;
+    fclose(file);
+    std::vector<uint8_t> raw(raw_size);
+    uLongf size = raw_size;
+    if (!complete || crc != crc32(0L, compressed.data(), payload_size) ||
+        uncompress(raw.data(), &size, compressed.data(), payload_size) != Z_OK || size != raw_size) {
+        return false;
+    }
+    frames.assign(count, Measurement());
+    uint16_t previous[PIXELS] = {};
+    for (size_t f = 0; f < count; f++) {
+        Measurement &frame = frames[f];
+        const uint8_t *record = raw.data() + f * FRAME_SIZE;
+        uint32_t flags;
+        memcpy(&frame.frame_no, record, 8);
+        memcpy(&frame.time_ms, record + 8, 8);
+        memcpy(&frame.ambient_temp, record + 16, 4);
+        memcpy(&frame.mean_temp_lpf, record + 20, 4);
+        memcpy(&flags, record + 24, 4);
+        frame.is_measuring = (flags & FLAG_MEASURING) != 0;
+        for (size_t i = 0; i < PIXELS; i++) {
+            uint16_t delta;
+            memcpy(&delta, record + 28 + i * 2, 2);
+            previous[i] = static_cast<uint16_t>(previous[i] + delta);
+            frame.temperatures[i] = static_cast<float>(static_cast<int16_t>(previous[i])) / TEMP_SCALE;
+        }
+    }
+    trigger = trigger_index;
+    return true;
+}
@@ -0,0 +1,37 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTCLIP_H
+#define THERMALCAM_ALERTCLIP_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "LiveMeasurement.h"
+
+// Radiometric clip of the frames around an alert, stored next to the alert image.
+//
+// File layout (host byte order): a 32 byte header (magic "TCCL", version, sensor width and height, number of
+// frames, index of the frame that triggered the alert, raw and compressed payload size, CRC of the compressed
+// payload), then the zlib compressed payload. For every frame the payload holds frame_no, time_ms, ambient and
+// smoothed temperature, a flags word and the temperatures in 0.01 degree steps, each one stored as the
+// difference to the same pixel in the previous frame, which compresses well because most pixels barely change.
+bool save_alert_clip(const std::vector<Measurement> &frames, size_t trigger, const std::string &path);
+
+bool load_alert_clip(const std::string &path, std::vector<Measurement> &frames, size_t &trigger);
+
+
+#endif //THERMALCAM_ALERTCLIP_H
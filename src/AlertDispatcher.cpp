@@ -0,0 +1,233 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <SDL2/SDL.h>
+#include "AlertDispatcher.h"
+#include "AlertImage.h"
+#include "Metrics.h"
+
+AlertDispatcher::AlertDispatcher(const std::string &token, const std::vector<std::string> &chat_ids,
+                                 const std::string &outbox_path, Uploaded _uploaded, AlertPolicy *_policy,
+                                 const std::string &api_url)
+        : bot(token, http_client, api_url), outbox(outbox_path, chat_ids), uploaded(std::move(_uploaded)),
+          policy(_policy), posted(0), stopping(false) {
+    for (const std::string &chat_id : chat_ids) {
+        chats.push_back({chat_id, clock::time_point(), 0});
+    }
+    outbox.open();
+    Metrics::instance().set("alert_outbox_depth", static_cast<double>(outbox.size()));
+    // chats is not resized after this, the senders keep references to their state
+    for (ChatState &chat : chats) {
+        senders.emplace_back(&AlertDispatcher::run, this, std::ref(chat));
+    }
+}
+
+AlertDispatcher::~AlertDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread &sender : senders) {
+        sender.join();
+    }
+}
+
+void AlertDispatcher::post(const Alert &alert) {
+    if (!outbox.append(alert)) {
+        Metrics::instance().add("alerts_dropped_total");
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox write failed, alert dropped");
+        return;
+    }
+    Metrics::instance().set("alert_outbox_depth", static_cast<double>(outbox.size()));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted++;
+    }
+    cv.notify_all();
+}
+
+void AlertDispatcher::run(ChatState &chat) {
+    clock::time_point next = clock::now();
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (next == clock::time_point::max()) {
+                cv.wait(lock, [this, seen] { return stopping || posted != seen; });
+            } else {
+                cv.wait_until(lock, next, [this, seen] { return stopping || posted != seen; });
+            }
+            if (stopping) {
+                return;
+            }
+            seen = posted;
+        }
+        // New alerts are made durable even while the network is down
+        outbox.sync();
+        const size_t expired = outbox.expire(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        if (expired > 0) {
+            Metrics::instance().add("alerts_expired_total", static_cast<double>(expired));
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%zu undelivered alerts expired from the outbox", expired);
+        }
+        if (chat.retry_at <= clock::now()) {
+            deliver(chat);
+        }
+        // Due again at once if a batch left alerts behind, at the retry time after a failure
+        next = outbox.pending(chat.chat_id, 1).empty() ? clock::time_point::max() : chat.retry_at;
+        Metrics::instance().set("alert_outbox_depth", static_cast<double>(outbox.size()));
+    }
+}
+
+// Request kinds of a batch: consecutive texts, or consecutive photos that another chat already uploaded, go in
+// one request; a photo that was never uploaded is sent alone (media groups cannot carry new files).
+enum BatchKind { BATCH_TEXT, BATCH_UPLOAD, BATCH_SHARED };
+
+static BatchKind batch_kind(const OutboxEntry &entry) {
+    if (entry.alert.image_path.empty() || !std::filesystem::is_regular_file(entry.alert.image_path)) {
+        // Text only, or the image was evicted from the store during a long outage
+        return BATCH_TEXT;
+    }
+    return entry.file_id.empty() ? BATCH_UPLOAD : BATCH_SHARED;
+}
+
+void AlertDispatcher::deliver(ChatState &chat) {
+    std::vector<OutboxEntry> pending = outbox.pending(chat.chat_id, MAX_BATCH);
+    if (pending.empty()) {
+        return;
+    }
+    if (policy != nullptr && !policy->allow(chat.chat_id, clock::now())) {
+        // The alerts wait in the outbox and go out with the next batch
+        Metrics::instance().add("alerts_rate_limited_total");
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Alerts to %s rate limited, %zu kept in the outbox",
+                    chat.chat_id.c_str(), pending.size());
+        chat.retry_at = clock::now() + RATE_LIMIT_RETRY;
+        return;
+    }
+    size_t first = 0;
+    while (first < pending.size()) {
+        const BatchKind kind = batch_kind(pending[first]);
+        size_t last = first + 1;
+        while (kind != BATCH_UPLOAD && last < pending.size() && batch_kind(pending[last]) == kind) {
+            last++;
+        }
+        const std::vector<OutboxEntry> batch(pending.begin() + first, pending.begin() + last);
+        std::vector<uint64_t> ids;
+        for (const OutboxEntry &entry : batch) {
+            ids.push_back(entry.id);
+        }
+        std::chrono::milliseconds retry_after(0);
+        const SendResult result = send(chat.chat_id, batch, retry_after);
+        if (result == SEND_RETRY) {
+            const std::chrono::milliseconds delay = retry_after.count() > 0 ? retry_after :
+                    std::min(FIRST_BACKOFF * (1 << std::min(chat.failures, 10)), MAX_BACKOFF);
+            chat.failures++;
+            chat.retry_at = clock::now() + delay;
+            Metrics::instance().add("alert_send_failures_total");
+            SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Alerts to %s kept in the outbox, retry in %lld ms",
+                        chat.chat_id.c_str(), static_cast<long long>(delay.count()));
+            return;
+        }
+        if (result == SEND_REJECTED) {
+            outbox.rejected(chat.chat_id, ids);
+            Metrics::instance().add("alerts_rejected_total", static_cast<double>(batch.size()));
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "%zu alerts to %s refused by Telegram, not retried",
+                         batch.size(), chat.chat_id.c_str());
+            first = last;
+            continue;
+        }
+        const size_t done = outbox.delivered(chat.chat_id, ids);
+        const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        const double latency_ms = static_cast<double>(now_ms - batch.back().queued_ms);
+        Metrics::instance().set("alert_delivery_latency_ms", latency_ms);
+        Metrics::instance().add("alerts_delivered_total", static_cast<double>(done));
+        if (batch.size() > 1) {
+            Metrics::instance().add("alert_batches_total");
+        }
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "%zu alerts delivered to %s, %.0f ms after posting",
+                    batch.size(), chat.chat_id.c_str(), latency_ms);
+        first = last;
+    }
+    chat.failures = 0;
+}
+
+AlertDispatcher::SendResult AlertDispatcher::send(const std::string &chat_id, const std::vector<OutboxEntry> &batch,
+                                                  std::chrono::milliseconds &retry_after) {
+    try {
+        const BatchKind kind = batch_kind(batch.front());
+        if (kind == BATCH_TEXT) {
+            std::string text;
+            for (const OutboxEntry &entry : batch) {
+                text += (text.empty() ? "" : "\n\n") + entry.alert.text;
+            }
+            bot.getApi().sendMessage(chat_id, text);
+        } else if (batch.size() == 1) {
+            // The text goes in the caption: one request per recipient instead of a photo plus a message.
+            const OutboxEntry &entry = batch.front();
+            TgBot::Message::Ptr sent;
+            if (kind == BATCH_SHARED) {
+                sent = bot.getApi().sendPhoto(chat_id, entry.file_id, entry.alert.text);
+            } else {
+                sent = bot.getApi().sendPhoto(
+                        chat_id, TgBot::InputFile::fromFile(entry.alert.image_path,
+                                                            alert_mime_type(entry.alert.image_path)),
+                        entry.alert.text);
+            }
+            uploaded_photo(entry, sent);
+        } else {
+            std::vector<TgBot::InputMedia::Ptr> group;
+            for (const OutboxEntry &entry : batch) {
+                TgBot::InputMediaPhoto::Ptr photo(new TgBot::InputMediaPhoto);
+                photo->media = entry.file_id;
+                photo->caption = entry.alert.text;
+                group.push_back(photo);
+            }
+            bot.getApi().sendMediaGroup(chat_id, group);
+        }
+        return SEND_OK;
+    } catch (TgBot::TgException &e) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert to %s failed: %s", chat_id.c_str(), e.what());
+        const int code = static_cast<int>(e.errorCode);
+        if (code == 429) {
+            // "Too Many Requests: retry after N"
+            const std::string description = e.what();
+            const size_t at = description.find("retry after ");
+            const long seconds = at == std::string::npos ? 0 : std::strtol(description.c_str() + at + 12, nullptr, 10);
+            retry_after = seconds > 0 ? std::chrono::milliseconds(seconds * 1000) : RATE_LIMIT_RETRY;
+            return SEND_RETRY;
+        }
+        return code >= 400 && code < 500 ? SEND_REJECTED : SEND_RETRY;
+    } catch (std::exception &e) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert to %s failed: %s", chat_id.c_str(), e.what());
+        return SEND_RETRY;
+    }
+}
+
+void AlertDispatcher::uploaded_photo(const OutboxEntry &entry, const TgBot::Message::Ptr &sent) {
+    if (!sent || sent->photo.empty()) {
+        return;
+    }
+    // The largest size comes last
+    const std::string file_id = sent->photo.back()->fileId;
+    if (outbox.set_file_id(entry.id, file_id) && uploaded) {
+        uploaded(entry.alert.time, file_id);
+    }
+}
@@ -0,0 +1,114 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTDISPATCHER_H
+#define THERMALCAM_ALERTDISPATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tgbot/tgbot.h>
+#include "AlertOutbox.h"
+#include "AlertPolicy.h"
+
+// Long-lived alert delivery service. Producers post alerts to a persistent outbox without blocking; one sender
+// thread per chat, started with the dispatcher, delivers them through one shared bot, so a slow chat does not
+// delay the others and each sender keeps its connection to the Bot API alive between alerts. A chat
+// that cannot be reached is retried with exponential backoff (or after the delay Telegram asks for when it rate
+// limits us) and its alerts stay in the outbox until it is back; a backlog is then sent in batches, oldest first,
+// with the captions written when the alerts were posted: texts merged in one message and photos already uploaded
+// to another chat in media groups. A request Telegram refuses for good (4xx other than 429, e.g. chat not found
+// or bot blocked) is not retried: its alerts are recorded as rejected for that chat.
+class AlertDispatcher {
+
+public:
+    // Called once per alert, on the dispatcher, with the Telegram file_id of the first successful photo upload.
+    typedef std::function<void(std::time_t time, const std::string &file_id)> Uploaded;
+
+    // policy (optional) rate limits each chat; it must outlive the dispatcher. api_url selects the Bot API
+    // server, e.g. a local stand-in for testing.
+    AlertDispatcher(const std::string &token, const std::vector<std::string> &chat_ids,
+                    const std::string &outbox_path, Uploaded uploaded, AlertPolicy *policy = nullptr,
+                    const std::string &api_url = "https://api.telegram.org");
+
+    virtual ~AlertDispatcher();
+
+    // Queue an alert. Only appends to the outbox, never blocks on the network.
+    void post(const Alert &alert);
+
+private:
+    // Alerts per request when sending a backlog, the maximum size of a media group
+    static const size_t MAX_BATCH = 10;
+    const std::chrono::milliseconds FIRST_BACKOFF = std::chrono::milliseconds(1000);
+    const std::chrono::milliseconds MAX_BACKOFF = std::chrono::milliseconds(60000);
+    // Retry delay for a chat that is over its rate limit
+    const std::chrono::milliseconds RATE_LIMIT_RETRY = std::chrono::milliseconds(5000);
+
+    typedef std::chrono::steady_clock clock;
+
+    enum SendResult {
+        SEND_OK,
+        // Network or server error, or rate limited: retry later
+        SEND_RETRY,
+        // Refused by Telegram for good
+        SEND_REJECTED,
+    };
+
+    struct ChatState {
+        std::string chat_id;
+        clock::time_point retry_at;
+        int failures;
+    };
+
+#ifdef HAVE_CURL
+    // Keeps one connection per calling thread, alive between the requests of a sender
+    TgBot::CurlHttpClient http_client;
+#else
+    TgBot::BoostHttpOnlySslClient http_client;
+#endif
+    TgBot::Bot bot;
+    AlertOutbox outbox;
+    const Uploaded uploaded;
+    AlertPolicy *policy;
+    std::vector<ChatState> chats;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Incremented by every post, each sender compares it with the last value it saw
+    uint64_t posted;
+    bool stopping;
+    std::vector<std::thread> senders;
+
+    // Sender thread of one chat.
+    void run(ChatState &chat);
+
+    void deliver(ChatState &chat);
+
+    // Send one request: a photo, a text message, a media group or several texts merged in one message.
+    // retry_after is set when Telegram asks to wait before the next request.
+    SendResult send(const std::string &chat_id, const std::vector<OutboxEntry> &batch,
+                    std::chrono::milliseconds &retry_after);
+
+    void uploaded_photo(const OutboxEntry &entry, const TgBot::Message::Ptr &sent);
+};
+
+
+#endif //THERMALCAM_ALERTDISPATCHER_H
@@ -0,0 +1,266 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <csetjmp>
+#include <jpeglib.h>
+#include <png.h>
+#include "AlertImage.h"
+#include "colormap.h"
+
+void colorize_temperatures(const float *temperatures, float vmin, float vmax, uint32_t *pixels) {
+    static const ColorMap cm = get_colormap_jet();
+    // Same mapping as ThermalCamera::update() / ThermalCamera::colormap()
+    for (int y = 0; y < SENSOR_W; y++) {
+        for (int x = 0; x < SENSOR_H; x++) {
+            const float v = (temperatures[SENSOR_H * (SENSOR_W - 1 - y) + x] - vmin) / (vmax - vmin);
+            const long color_index = std::min(255L, std::max(0L, std::lround(255 * v)));
+            pixels[x * SENSOR_W + y] = Rasterizer::rgb(cm.r.at(color_index), cm.g.at(color_index),
+                                                       cm.b.at(color_index));
+        }
+    }
+}
+
+void render_alert_image(const AlertSnapshot &snapshot, Rasterizer &raster) {
+    const uint32_t white = Rasterizer::rgb(255, 255, 255);
+    const uint32_t black = Rasterizer::rgb(0, 0, 0);
+    uint32_t pixels[SENSOR_W * SENSOR_H];
+    colorize_temperatures(snapshot.temperatures, snapshot.colormap_min, snapshot.colormap_max, pixels);
+    raster.clear(black);
+    raster.blit_scaled(pixels, SENSOR_W, SENSOR_H, snapshot.image_x, snapshot.image_y, snapshot.image_w,
+                       snapshot.image_h);
+    if (!snapshot.is_measuring) {
+        return;
+    }
+    // Labels, same layout as ThermalCamera::render_temp_labels()
+    // (the bitmap font is wider than the display font, so the reading goes on a second line)
+    const int small = 3;
+    const int large = 8;
+    raster.draw_text("Temperatura corporal:", 0, 640, small, white);
+    raster.draw_text(snapshot.message, snapshot.width - Rasterizer::text_width(snapshot.message, small),
+                     640 + Rasterizer::text_height(small) + small, small, white);
+    raster.draw_text(snapshot.label, 0, snapshot.height - Rasterizer::text_height(large), large, white);
+    // Slider, same layout as ThermalCamera::render_slider()
+    const int ys1 = 670 + 20;
+    const int ys2 = 670 + 60;
+    const int margin1 = 4;
+    const int margin2 = margin1 + 2;
+    static const ColorMap cm = get_colormap_jet();
+    for (int x = 0; x < snapshot.width; x++) {
+        const size_t color_index = static_cast<size_t>(x) * 255 / std::max(1, snapshot.width - 1);
+        raster.fill_rect(x, ys1, 1, ys2 - ys1, Rasterizer::rgb(cm.r.at(color_index), cm.g.at(color_index),
+                                                                cm.b.at(color_index)));
+    }
+    raster.fill_rect(snapshot.marker_x - margin2, ys1 - margin2, 2 * margin2, ys2 - ys1 + 2 * margin2, black);
+    raster.fill_rect(snapshot.marker_x - margin1, ys1 - margin1, 2 * margin1, ys2 - ys1 + 2 * margin1, white);
+}
+
+std::string alert_file_stem(std::time_t time) {
+    std::tm local_time = {};
+    localtime_r(&time, &local_time);
+    std::stringstream ss;
+    ss << std::put_time(&local_time, "%d%m%y_%H.%M.%S");
+    return ss.str();
+}
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool is_alert_image(const std::string &path) {
+    return (ends_with(path, ".png") || ends_with(path, ".bmp")) && !ends_with(path, "_prev.png");
+}
+
+std::string alert_mime_type(const std::string &path) {
+    if (ends_with(path, ".jpg")) {
+        return "image/jpeg";
+    }
+    return ends_with(path, ".bmp") ? "image/bmp" : "image/png";
+}
+
+static std::string derivative_path(const std::string &path, const std::string &suffix) {
+    const size_t dot = path.find_last_of('.');
+    return (dot == std::string::npos ? path : path.substr(0, dot)) + suffix;
+}
+
+std::string alert_preview_path(const std::string &path) {
+    return derivative_path(path, "_prev.png");
+}
+
+std::string alert_thumbnail_path(const std::string &path) {
+    return derivative_path(path, "_thumb.jpg");
+}
+
+std::string alert_clip_path(const std::string &path) {
+    return derivative_path(path, ".clip");
+}
+
+std::vector<std::string> alert_files(const std::string &path) {
+    return {path, alert_preview_path(path), alert_thumbnail_path(path), alert_clip_path(path)};
+}
+
+bool save_alert_derivatives(const Rasterizer &raster, const std::string &path) {
+    // Half size keeps the labels readable. The preview is mostly flat blocks of color, which PNG compresses
+    // better than JPEG; at thumbnail size the blocks are averaged away and JPEG is smaller.
+    const Rasterizer preview = raster.downscaled(raster.get_width() / 2, raster.get_height() / 2);
+    const Rasterizer thumbnail = raster.downscaled(raster.get_width() / 5, raster.get_height() / 5);
+    return save_png(preview, alert_preview_path(path)) && save_jpeg(thumbnail, alert_thumbnail_path(path), 70);
+}
+
+bool ensure_alert_derivatives(const std::string &path) {
+    if (std::filesystem::is_regular_file(alert_preview_path(path)) &&
+        std::filesystem::is_regular_file(alert_thumbnail_path(path))) {
+        return true;
+    }
+    // Only the full screen BMP screenshots of older installations are worth converting afterwards.
+    Rasterizer raster(1, 1);
+    return ends_with(path, ".bmp") && raster.load_bmp(path) && save_alert_derivatives(raster, path);
+}
+
+// Images are written under a temporary name and renamed into place, so nobody reads a half-written file: two bot
+// workers may generate the same derivative while one of them is already uploading it.
+static std::string temporary_path(const std::string &path) {
+    static std::atomic<unsigned> counter(0);
+    return path + ".tmp" + std::to_string(counter++);
+}
+
+static bool commit_file(FILE *file, bool written, const std::string &temporary, const std::string &path) {
+    if (fclose(file) == 0 && written && rename(temporary.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+    remove(temporary.c_str());
+    return false;
+}
+
+// libpng reports errors by longjmp() back to the setjmp() here, so this frame holds no objects with destructors and
+// nothing it changes after setjmp() is used on the error path; the row buffer belongs to the caller.
+static bool write_png(FILE *file, const Rasterizer &raster, png_byte *row) {
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = png == nullptr ? nullptr : png_create_info_struct(png);
+    if (info == nullptr || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return false;
+    }
+    png_init_io(png, file);
+    // The images are mostly flat upscaled blocks, a fast compression level is already very effective.
+    png_set_compression_level(png, 3);
+    png_set_IHDR(png, info, raster.get_width(), raster.get_height(), 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    const uint32_t *data = raster.data().data();
+    for (int y = 0; y < raster.get_height(); y++) {
+        for (int x = 0; x < raster.get_width(); x++) {
+            const uint32_t p = data[static_cast<size_t>(y) * raster.get_width() + x];
+            row[x * 3] = p & 0xFFu;
+            row[x * 3 + 1] = (p >> 8u) & 0xFFu;
+            row[x * 3 + 2] = (p >> 16u) & 0xFFu;
+        }
+        png_write_row(png, row);
+    }
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    return true;
+}
+
+bool save_png(const Rasterizer &raster, const std::string &path) {
+    std::vector<png_byte> row(static_cast<size_t>(raster.get_width()) * 3);
+    const std::string temporary = temporary_path(path);
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = write_png(file, raster, row.data());
+    return commit_file(file, written, temporary, path);
+}
+
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+// Same constraints as write_png(): error_exit longjmp()s back here. The compressor state, the row buffer and the
+// output buffer that libjpeg grows belong to the caller.
+static bool compress_jpeg(const Rasterizer &raster, int quality, jpeg_compress_struct *jpeg, JpegError *error,
+                          JSAMPLE *row, unsigned char **buffer, unsigned long *size) {
+    jpeg->err = jpeg_std_error(&error->manager);
+    // The default handler calls exit(), return to here instead.
+    error->manager.error_exit = [](j_common_ptr info) {
+        longjmp(reinterpret_cast<JpegError *>(info->err)->jump, 1);
+    };
+    if (setjmp(error->jump)) {
+        jpeg_destroy_compress(jpeg);
+        return false;
+    }
+    jpeg_create_compress(jpeg);
+    jpeg_mem_dest(jpeg, buffer, size);
+    jpeg->image_width = raster.get_width();
+    jpeg->image_height = raster.get_height();
+    jpeg->input_components = 3;
+    jpeg->in_color_space = JCS_RGB;
+    jpeg_set_defaults(jpeg);
+    jpeg_set_quality(jpeg, quality, TRUE);
+    jpeg_start_compress(jpeg, TRUE);
+    const uint32_t *data = raster.data().data();
+    while (jpeg->next_scanline < jpeg->image_height) {
+        for (int x = 0; x < raster.get_width(); x++) {
+            const uint32_t p = data[static_cast<size_t>(jpeg->next_scanline) * raster.get_width() + x];
+            row[x * 3] = p & 0xFFu;
+            row[x * 3 + 1] = (p >> 8u) & 0xFFu;
+            row[x * 3 + 2] = (p >> 16u) & 0xFFu;
+        }
+        JSAMPROW row_pointer = row;
+        jpeg_write_scanlines(jpeg, &row_pointer, 1);
+    }
+    jpeg_finish_compress(jpeg);
+    jpeg_destroy_compress(jpeg);
+    return true;
+}
+
+bool encode_jpeg(const Rasterizer &raster, int quality, std::string &jpeg_data) {
+    jpeg_compress_struct jpeg = {};
+    JpegError error = {};
+    std::vector<JSAMPLE> row(static_cast<size_t>(raster.get_width()) * 3);
+    unsigned char *buffer = nullptr;
+    unsigned long size = 0;
+    const bool encoded = compress_jpeg(raster, quality, &jpeg, &error, row.data(), &buffer, &size);
+    if (encoded) {
+        jpeg_data.assign(reinterpret_cast<const char *>(buffer), size);
+    }
+    free(buffer);
+    return encoded;
+}
+
+bool save_jpeg(const Rasterizer &raster, const std::string &path, int quality) {
+    std::string jpeg_data;
+    if (!encode_jpeg(raster, quality, jpeg_data)) {
+        return false;
+    }
+    const std::string temporary = temporary_path(path);
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const bool written = fwrite(jpeg_data.data(), 1, jpeg_data.size(), file) == jpeg_data.size();
+    return commit_file(file, written, temporary, path);
+}
@@ -0,0 +1,97 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTIMAGE_H
+#define THERMALCAM_ALERTIMAGE_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include "constants.h"
+#include "LiveMeasurement.h"
+#include "Rasterizer.h"
+
+// Everything needed to draw an alert image, copied from the camera when the alert fires so the image can be
+// rendered and encoded on another thread.
+struct AlertSnapshot {
+    std::time_t time;
+    size_t frame_no;
+    // Temperatures as produced by MLX90640_CalculateTo()
+    float temperatures[SENSOR_W * SENSOR_H];
+    float colormap_min;
+    float colormap_max;
+    // Overlay state
+    bool is_measuring;
+    float mean_temp_lpf;
+    // Estimated environment temperature
+    float ambient_temp;
+    std::string message;
+    std::string label;
+    int marker_x;
+    // Layout
+    int width;
+    int height;
+    int image_x;
+    int image_y;
+    int image_w;
+    int image_h;
+    // Frames before and after the alert (empty if none), saved as a clip next to the image. The still above is
+    // the frame clip[clip_trigger] or the hottest frame of the clip.
+    std::vector<Measurement> clip;
+    size_t clip_trigger;
+};
+
+// Draw the thermal image and overlay (labels, slider) of a snapshot, with the same layout as the display.
+void render_alert_image(const AlertSnapshot &snapshot, Rasterizer &raster);
+
+// Colorize a temperature buffer into a SENSOR_W x SENSOR_H image, with the display orientation.
+void colorize_temperatures(const float *temperatures, float vmin, float vmax, uint32_t *pixels);
+
+// File name (without folder and extension) for an alert taken at the given time: ddmmyy_HH.MM.SS
+std::string alert_file_stem(std::time_t time);
+
+// Alert images are PNG, older installations stored BMP screenshots.
+bool is_alert_image(const std::string &path);
+
+std::string alert_mime_type(const std::string &path);
+
+// Both write a temporary file and rename it into place, so the file is either absent or complete.
+bool save_png(const Rasterizer &raster, const std::string &path);
+
+bool save_jpeg(const Rasterizer &raster, const std::string &path, int quality);
+
+// JPEG file contents in memory, for images sent without touching the disk.
+bool encode_jpeg(const Rasterizer &raster, int quality, std::string &jpeg_data);
+
+// Every alert image gets two derivatives next to it, so the bot does not upload the original over the cellular
+// link: a half size PNG preview, which the bot sends, and a small JPEG thumbnail.
+std::string alert_preview_path(const std::string &path);
+
+std::string alert_thumbnail_path(const std::string &path);
+
+// Radiometric clip of the frames around the alert, see AlertClip.h.
+std::string alert_clip_path(const std::string &path);
+
+// The image, its derivatives and its clip.
+std::vector<std::string> alert_files(const std::string &path);
+
+bool save_alert_derivatives(const Rasterizer &raster, const std::string &path);
+
+// Create the derivatives of an existing image if they are missing (BMP only). False if there are none.
+bool ensure_alert_derivatives(const std::string &path);
+
+
+#endif //THERMALCAM_ALERTIMAGE_H
@@ -0,0 +1,340 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <SDL2/SDL.h>
+#include "AlertJournal.h"
+#include "AlertImage.h"
+
+AlertJournal::AlertJournal(const std::string &_path) : path(_path), fd(-1), index_bytes(0) {
+}
+
+AlertJournal::~AlertJournal() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool AlertJournal::open(const std::string &legacy_folder) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    const bool exists = std::filesystem::exists(path);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open alert journal %s", path.c_str());
+        return false;
+    }
+    // Replay the journal
+    index.clear();
+    index_bytes = 0;
+    uint8_t record[RECORD_SIZE];
+    off_t valid_size = 0;
+    while (pread(fd, record, RECORD_SIZE, valid_size) == static_cast<ssize_t>(RECORD_SIZE)) {
+        uint32_t magic, crc;
+        uint16_t version, kind;
+        memcpy(&magic, record, 4);
+        memcpy(&version, record + 4, 2);
+        memcpy(&kind, record + 6, 2);
+        memcpy(&crc, record + RECORD_SIZE - 8, 4);
+        if (magic != MAGIC || version != VERSION || crc != crc32(0L, record, RECORD_SIZE - 8)) {
+            break;
+        }
+        AlertEntry entry;
+        int64_t time;
+        memcpy(&time, record + 8, 8);
+        entry.time = static_cast<std::time_t>(time);
+        memcpy(&entry.temp, record + 16, 4);
+        memcpy(&entry.ambient, record + 20, 4);
+        const char *record_path = reinterpret_cast<const char *>(record + 24);
+        entry.path.assign(record_path, strnlen(record_path, PATH_SIZE));
+        entry.bytes = 0;
+        if (kind == RECORD_ADD) {
+            entry.bytes = files_size(entry.path);
+        }
+        apply(static_cast<RecordKind>(kind), entry);
+        valid_size += RECORD_SIZE;
+    }
+    if (lseek(fd, 0, SEEK_END) != valid_size) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Alert journal: dropping damaged tail after %lld bytes",
+                    static_cast<long long>(valid_size));
+        if (ftruncate(fd, valid_size) != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert journal: truncate failed");
+        }
+    }
+    if (!exists && !legacy_folder.empty() && std::filesystem::is_directory(legacy_folder)) {
+        // One-time import of the images stored before the journal existed
+        std::vector<AlertEntry> legacy;
+        for (const auto &file : std::filesystem::directory_iterator(legacy_folder)) {
+            const std::string file_path = file.path().string();
+            const std::time_t time = parse_file_time(file_path);
+            if (file.is_regular_file() && is_alert_image(file_path) && time >= 0) {
+                legacy.push_back({time, NAN, NAN, file_path, files_size(file_path)});
+            }
+        }
+        std::sort(legacy.begin(), legacy.end(), [](const AlertEntry &a, const AlertEntry &b) {
+            return a.time < b.time;
+        });
+        for (const AlertEntry &entry : legacy) {
+            if (write_record(RECORD_ADD, entry)) {
+                apply(RECORD_ADD, entry);
+            }
+        }
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Alert journal: imported %zu existing images", legacy.size());
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Alert journal: %zu alerts", index.size());
+    return true;
+}
+
+uint64_t AlertJournal::files_size(const std::string &image_path) {
+    uint64_t bytes = 0;
+    for (const std::string &file : alert_files(image_path)) {
+        std::error_code error;
+        const uintmax_t file_size = std::filesystem::file_size(file, error);
+        bytes += error ? 0 : file_size;
+    }
+    return bytes;
+}
+
+bool AlertJournal::write_record(RecordKind kind, const AlertEntry &entry) {
+    if (fd < 0) {
+        return false;
+    }
+    uint8_t record[RECORD_SIZE] = {};
+    const uint32_t magic = MAGIC;
+    const uint16_t version = VERSION;
+    const uint16_t kind_value = kind;
+    const int64_t time = entry.time;
+    memcpy(record, &magic, 4);
+    memcpy(record + 4, &version, 2);
+    memcpy(record + 6, &kind_value, 2);
+    memcpy(record + 8, &time, 8);
+    memcpy(record + 16, &entry.temp, 4);
+    memcpy(record + 20, &entry.ambient, 4);
+    if (entry.path.size() >= PATH_SIZE) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert journal: path too long %s", entry.path.c_str());
+        return false;
+    }
+    memcpy(record + 24, entry.path.data(), entry.path.size());
+    const uint32_t crc = crc32(0L, record, RECORD_SIZE - 8);
+    memcpy(record + RECORD_SIZE - 8, &crc, 4);
+    if (write(fd, record, RECORD_SIZE) != static_cast<ssize_t>(RECORD_SIZE)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert journal: write failed");
+        return false;
+    }
+    fdatasync(fd);
+    return true;
+}
+
+void AlertJournal::apply(RecordKind kind, const AlertEntry &entry) {
+    if (kind == RECORD_ADD) {
+        // Records are appended in time order, so this is normally a push_back.
+        auto it = std::upper_bound(index.begin(), index.end(), entry.time, [](std::time_t t, const AlertEntry &e) {
+            return t < e.time;
+        });
+        index.insert(it, entry);
+        index_bytes += entry.bytes;
+    } else if (kind == RECORD_EVICT) {
+        // Evictions are in time order as well, so the entry is normally the oldest one.
+        auto it = index.begin();
+        while (it != index.end() && it->path != entry.path) {
+            ++it;
+        }
+        if (it != index.end()) {
+            index_bytes -= it->bytes;
+            index.erase(it);
+        }
+    } else if (kind == RECORD_FILE_ID) {
+        auto it = std::lower_bound(index.begin(), index.end(), entry.time, [](const AlertEntry &e, std::time_t t) {
+            return e.time < t;
+        });
+        if (it != index.end() && it->time == entry.time) {
+            it->file_id = entry.path;
+        }
+    }
+}
+
+bool AlertJournal::append(const AlertEntry &entry) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (!write_record(RECORD_ADD, entry)) {
+        return false;
+    }
+    apply(RECORD_ADD, entry);
+    return true;
+}
+
+bool AlertJournal::pop_oldest(AlertEntry &entry) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (index.empty() || !write_record(RECORD_EVICT, index.front())) {
+        return false;
+    }
+    entry = index.front();
+    index_bytes -= entry.bytes;
+    index.pop_front();
+    return true;
+}
+
+bool AlertJournal::set_file_id(std::time_t time, const std::string &file_id) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    AlertEntry record = {time, NAN, NAN, file_id, 0};
+    if (!write_record(RECORD_FILE_ID, record)) {
+        return false;
+    }
+    apply(RECORD_FILE_ID, record);
+    return true;
+}
+
+void AlertJournal::set_bytes(std::time_t time, uint64_t bytes) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = std::lower_bound(index.begin(), index.end(), time, [](const AlertEntry &e, std::time_t t) {
+        return e.time < t;
+    });
+    if (it != index.end() && it->time == time) {
+        index_bytes = index_bytes - it->bytes + bytes;
+        it->bytes = bytes;
+    }
+}
+
+bool AlertJournal::oldest(AlertEntry &entry) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if (index.empty()) {
+        return false;
+    }
+    entry = index.front();
+    return true;
+}
+
+bool AlertJournal::latest(AlertEntry &entry) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if (index.empty()) {
+        return false;
+    }
+    entry = index.back();
+    return true;
+}
+
+std::vector<AlertEntry> AlertJournal::range(std::time_t from, std::time_t to) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto first = std::lower_bound(index.begin(), index.end(), from, [](const AlertEntry &e, std::time_t t) {
+        return e.time < t;
+    });
+    auto last = std::lower_bound(first, index.end(), to, [](const AlertEntry &e, std::time_t t) {
+        return e.time < t;
+    });
+    return std::vector<AlertEntry>(first, last);
+}
+
+std::vector<AlertEntry> AlertJournal::query(const AlertQuery &query) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto by_time = [](const AlertEntry &e, std::time_t t) {
+        return e.time < t;
+    };
+    auto first = std::lower_bound(index.begin(), index.end(), query.from, by_time);
+    auto last = query.to == 0 ? index.end() : std::lower_bound(first, index.end(), query.to, by_time);
+    std::vector<AlertEntry> result;
+    auto take = [&query, &result](const AlertEntry &entry) {
+        if (query.matches(entry.temp)) {
+            result.push_back(entry);
+        }
+        return query.limit == 0 || result.size() < query.limit;
+    };
+    if (query.newest_first) {
+        for (auto it = last; it != first && take(*(it - 1)); --it) {
+        }
+    } else {
+        for (auto it = first; it != last && take(*it); ++it) {
+        }
+    }
+    return result;
+}
+
+std::vector<AlertEntry> AlertJournal::all() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return std::vector<AlertEntry>(index.begin(), index.end());
+}
+
+size_t AlertJournal::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return index.size();
+}
+
+uint64_t AlertJournal::total_bytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return index_bytes;
+}
+
+std::time_t AlertJournal::start_of_day(std::time_t t) {
+    std::tm local = {};
+    localtime_r(&t, &local);
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+std::time_t AlertJournal::start_of_next_day(std::time_t t) {
+    std::tm local = {};
+    localtime_r(&t, &local);
+    local.tm_mday += 1;
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+std::time_t AlertJournal::start_of_month(std::time_t t) {
+    std::tm local = {};
+    localtime_r(&t, &local);
+    local.tm_mday = 1;
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+std::time_t AlertJournal::start_of_next_month(std::time_t t) {
+    std::tm local = {};
+    localtime_r(&t, &local);
+    local.tm_mon += 1;
+    local.tm_mday = 1;
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+std::time_t AlertJournal::parse_file_time(const std::string &file_path) {
+    const std::string stem = std::filesystem::path(file_path).stem().string();
+    std::tm local = {};
+    std::istringstream ss(stem);
+    ss >> std::get_time(&local, "%d%m%y_%H.%M.%S");
+    if (ss.fail()) {
+        return -1;
+    }
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
@@ -0,0 +1,128 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTJOURNAL_H
+#define THERMALCAM_ALERTJOURNAL_H
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "AlertQuery.h"
+
+struct AlertEntry {
+    std::time_t time;
+    // Calibrated body temperature and estimated ambient temperature at the time of the alert
+    float temp;
+    float ambient;
+    std::string path;
+    // Size on disk of the image and its derivatives, taken from the file system when the journal is loaded
+    uint64_t bytes;
+    // Telegram file_id of the uploaded photo, empty until it was sent once. Lets the bot resend it (e.g. in
+    // media groups) without uploading the file again.
+    std::string file_id;
+};
+
+// Append-only journal of stored alerts, with an in-memory index sorted by time that is rebuilt from the file at
+// startup. Replaces scanning the pictures folder and parsing file names for every bot request.
+//
+// On disk every record is RECORD_SIZE bytes (host byte order) and carries a CRC, so a record torn by a power
+// loss is detected and dropped when the journal is opened.
+class AlertJournal {
+
+public:
+    explicit AlertJournal(const std::string &path);
+
+    virtual ~AlertJournal();
+
+    // Load the journal and build the index. If the journal does not exist yet, the alert images already in
+    // legacy_folder are imported once (time from the file name, temperatures unknown).
+    bool open(const std::string &legacy_folder);
+
+    bool append(const AlertEntry &entry);
+
+    // Remove the oldest alert from the index and record its eviction. The caller deletes the file.
+    bool pop_oldest(AlertEntry &entry);
+
+    bool oldest(AlertEntry &entry) const;
+
+    // Remember the Telegram file_id of the alert taken at the given time.
+    bool set_file_id(std::time_t time, const std::string &file_id);
+
+    // Update the size of an alert whose derivatives were created later. Sizes are not journaled: they are taken
+    // from the file system when the journal is loaded.
+    void set_bytes(std::time_t time, uint64_t bytes);
+
+    // Latest alert, false if there is none.
+    bool latest(AlertEntry &entry) const;
+
+    // Alerts with from <= time < to, oldest first.
+    std::vector<AlertEntry> range(std::time_t from, std::time_t to) const;
+
+    std::vector<AlertEntry> all() const;
+
+    // Alerts matching the query, in the order it asks for. Binary search on the time range, then a filter.
+    std::vector<AlertEntry> query(const AlertQuery &query) const;
+
+    size_t size() const;
+
+    // Sum of the image sizes of all alerts in the index.
+    uint64_t total_bytes() const;
+
+    // Local time boundaries for "today" and "this month" queries.
+    static std::time_t start_of_day(std::time_t t);
+
+    static std::time_t start_of_next_day(std::time_t t);
+
+    static std::time_t start_of_month(std::time_t t);
+
+    static std::time_t start_of_next_month(std::time_t t);
+
+    // Parse the time from an alert file name (ddmmyy_HH.MM.SS), -1 if it does not match.
+    static std::time_t parse_file_time(const std::string &path);
+
+    // Size on disk of an alert image and its derivatives.
+    static uint64_t files_size(const std::string &image_path);
+
+private:
+    static const uint32_t MAGIC = 0x4A414354; // "TCAJ"
+    static const uint16_t VERSION = 1;
+    static const size_t RECORD_SIZE = 256;
+    static const size_t PATH_SIZE = 224;
+
+    enum RecordKind : uint16_t {
+        RECORD_ADD = 1,
+        RECORD_EVICT = 2,
+        // Stores the file_id in the path field, the alert is identified by its time.
+        RECORD_FILE_ID = 3,
+    };
+
+    const std::string path;
+    int fd;
+    mutable std::shared_mutex mutex;
+    // Sorted by time; evictions take the oldest, so this is a deque to pop it in O(1).
+    std::deque<AlertEntry> index;
+    uint64_t index_bytes;
+
+    bool write_record(RecordKind kind, const AlertEntry &entry);
+
+    void apply(RecordKind kind, const AlertEntry &entry);
+};
+
+
+#endif //THERMALCAM_ALERTJOURNAL_H
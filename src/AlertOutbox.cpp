@@ -0,0 +1,318 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <SDL2/SDL.h>
+#include "AlertOutbox.h"
+
+AlertOutbox::AlertOutbox(const std::string &_path, const std::vector<std::string> &_chat_ids)
+        : path(_path), chat_ids(_chat_ids), fd(-1), dirty(false), next_id(1) {
+}
+
+AlertOutbox::~AlertOutbox() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool AlertOutbox::open() {
+    std::lock_guard<std::mutex> lock(mutex);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open alert outbox %s", path.c_str());
+        return false;
+    }
+    // Replay the outbox
+    entries.clear();
+    off_t valid_size = 0;
+    uint8_t header[HEADER_SIZE];
+    while (pread(fd, header, HEADER_SIZE, valid_size) == static_cast<ssize_t>(HEADER_SIZE)) {
+        uint32_t magic, length, crc;
+        uint16_t kind, version;
+        memcpy(&magic, header, 4);
+        memcpy(&kind, header + 4, 2);
+        memcpy(&version, header + 6, 2);
+        memcpy(&length, header + 8, 4);
+        memcpy(&crc, header + 12, 4);
+        if (magic != MAGIC || version != VERSION || length > MAX_PAYLOAD) {
+            break;
+        }
+        std::string payload(length, '\0');
+        if (pread(fd, &payload[0], length, valid_size + HEADER_SIZE) != static_cast<ssize_t>(length) ||
+            crc != crc32(crc32(0L, header + 4, 8), reinterpret_cast<const Bytef *>(payload.data()), length)) {
+            break;
+        }
+        apply(static_cast<RecordKind>(kind), payload);
+        valid_size += HEADER_SIZE + length;
+    }
+    if (lseek(fd, 0, SEEK_END) != valid_size) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: dropping damaged tail after %lld bytes",
+                    static_cast<long long>(valid_size));
+    }
+    // Alerts delivered to (or refused by) every chat of the current configuration are done
+    for (auto it = entries.begin(); it != entries.end();) {
+        it = complete(it->second) ? entries.erase(it) : std::next(it);
+    }
+    const size_t expired = expire_locked(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(), false);
+    if (expired > 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: %zu expired alerts dropped", expired);
+    }
+    if (!entries.empty()) {
+        next_id = entries.rbegin()->first + 1;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: %zu alerts pending delivery", entries.size());
+    }
+    return compact();
+}
+
+bool AlertOutbox::compact() {
+    if (entries.empty()) {
+        if (ftruncate(fd, 0) != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: truncate failed");
+            return false;
+        }
+        return true;
+    }
+    // Write the pending alerts to a new file and swap it in, so a crash leaves either file complete.
+    const std::string tmp_path = path + ".tmp";
+    int tmp_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (tmp_fd < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: unable to create %s", tmp_path.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (const auto &item : entries) {
+        ok = ok && write_record(tmp_fd, RECORD_ALERT, encode_alert(item.second));
+        for (const std::string &chat_id : item.second.delivered) {
+            ok = ok && write_record(tmp_fd, RECORD_DELIVERED, encode_delivered(item.first, chat_id));
+        }
+        for (const std::string &chat_id : item.second.rejected) {
+            ok = ok && write_record(tmp_fd, RECORD_REJECTED, encode_delivered(item.first, chat_id));
+        }
+    }
+    ok = ok && fdatasync(tmp_fd) == 0;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: compaction failed");
+        close(tmp_fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    close(fd);
+    fd = tmp_fd;
+    return true;
+}
+
+std::string AlertOutbox::encode_alert(const OutboxEntry &entry) {
+    const int64_t time = entry.alert.time;
+    const uint32_t path_size = static_cast<uint32_t>(entry.alert.image_path.size());
+    std::string payload(28, '\0');
+    memcpy(&payload[0], &entry.id, 8);
+    memcpy(&payload[8], &entry.queued_ms, 8);
+    memcpy(&payload[16], &time, 8);
+    memcpy(&payload[24], &path_size, 4);
+    return payload + entry.alert.image_path + entry.alert.text;
+}
+
+std::string AlertOutbox::encode_delivered(uint64_t id, const std::string &chat_id) {
+    std::string payload(8, '\0');
+    memcpy(&payload[0], &id, 8);
+    return payload + chat_id;
+}
+
+std::string AlertOutbox::encode_id(uint64_t id) {
+    std::string payload(8, '\0');
+    memcpy(&payload[0], &id, 8);
+    return payload;
+}
+
+bool AlertOutbox::write_record(int fd, RecordKind kind, const std::string &payload) {
+    if (fd < 0 || payload.size() > MAX_PAYLOAD) {
+        return false;
+    }
+    // One write() per record, appended atomically
+    std::string record(HEADER_SIZE, '\0');
+    const uint32_t magic = MAGIC;
+    const uint16_t kind_value = kind;
+    const uint16_t version = VERSION;
+    const uint32_t length = static_cast<uint32_t>(payload.size());
+    memcpy(&record[0], &magic, 4);
+    memcpy(&record[4], &kind_value, 2);
+    memcpy(&record[6], &version, 2);
+    memcpy(&record[8], &length, 4);
+    const uint32_t crc = crc32(crc32(0L, reinterpret_cast<const Bytef *>(&record[4]), 8),
+                               reinterpret_cast<const Bytef *>(payload.data()), length);
+    memcpy(&record[12], &crc, 4);
+    record += payload;
+    if (write(fd, record.data(), record.size()) != static_cast<ssize_t>(record.size())) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: write failed");
+        return false;
+    }
+    return true;
+}
+
+void AlertOutbox::apply(RecordKind kind, const std::string &payload) {
+    if (kind == RECORD_ALERT && payload.size() >= 28) {
+        OutboxEntry entry;
+        int64_t time;
+        uint32_t path_size;
+        memcpy(&entry.id, &payload[0], 8);
+        memcpy(&entry.queued_ms, &payload[8], 8);
+        memcpy(&time, &payload[16], 8);
+        memcpy(&path_size, &payload[24], 4);
+        if (path_size > payload.size() - 28) {
+            return;
+        }
+        entry.alert.time = static_cast<std::time_t>(time);
+        entry.alert.image_path = payload.substr(28, path_size);
+        entry.alert.text = payload.substr(28 + path_size);
+        entries[entry.id] = entry;
+    } else if ((kind == RECORD_DELIVERED || kind == RECORD_REJECTED) && payload.size() >= 8) {
+        uint64_t id;
+        memcpy(&id, &payload[0], 8);
+        auto it = entries.find(id);
+        if (it != entries.end()) {
+            (kind == RECORD_DELIVERED ? it->second.delivered : it->second.rejected).insert(payload.substr(8));
+        }
+    } else if (kind == RECORD_EXPIRED && payload.size() >= 8) {
+        uint64_t id;
+        memcpy(&id, &payload[0], 8);
+        entries.erase(id);
+    }
+}
+
+bool AlertOutbox::complete(const OutboxEntry &entry) const {
+    for (const std::string &chat_id : chat_ids) {
+        if (entry.delivered.count(chat_id) == 0 && entry.rejected.count(chat_id) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AlertOutbox::append(const Alert &alert) {
+    std::lock_guard<std::mutex> lock(mutex);
+    OutboxEntry entry;
+    entry.id = next_id;
+    entry.queued_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    entry.alert = alert;
+    if (!write_record(fd, RECORD_ALERT, encode_alert(entry))) {
+        return false;
+    }
+    dirty = true;
+    next_id++;
+    entries[entry.id] = entry;
+    return true;
+}
+
+void AlertOutbox::sync() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!dirty || fd < 0) {
+        return;
+    }
+    dirty = false;
+    const int sync_fd = fd;
+    // Do not hold the lock while the disk flushes, appends keep going to the page cache.
+    lock.unlock();
+    fdatasync(sync_fd);
+}
+
+std::vector<OutboxEntry> AlertOutbox::pending(const std::string &chat_id, size_t max) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<OutboxEntry> result;
+    for (auto it = entries.begin(); it != entries.end() && result.size() < max; ++it) {
+        if (it->second.delivered.count(chat_id) == 0 && it->second.rejected.count(chat_id) == 0) {
+            result.push_back(it->second);
+        }
+    }
+    return result;
+}
+
+size_t AlertOutbox::delivered(const std::string &chat_id, const std::vector<uint64_t> &ids) {
+    return done(chat_id, ids, RECORD_DELIVERED);
+}
+
+size_t AlertOutbox::rejected(const std::string &chat_id, const std::vector<uint64_t> &ids) {
+    return done(chat_id, ids, RECORD_REJECTED);
+}
+
+size_t AlertOutbox::done(const std::string &chat_id, const std::vector<uint64_t> &ids, RecordKind kind) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t completed = 0;
+    for (uint64_t id : ids) {
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            continue;
+        }
+        // Not synced: after a power loss the alert may be sent to this chat again, but never lost.
+        write_record(fd, kind, encode_delivered(id, chat_id));
+        (kind == RECORD_DELIVERED ? it->second.delivered : it->second.rejected).insert(chat_id);
+        if (complete(it->second)) {
+            entries.erase(it);
+            completed++;
+        }
+    }
+    truncate_if_empty();
+    return completed;
+}
+
+size_t AlertOutbox::expire(int64_t now_ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t expired = expire_locked(now_ms, true);
+    if (expired > 0) {
+        truncate_if_empty();
+    }
+    return expired;
+}
+
+size_t AlertOutbox::expire_locked(int64_t now_ms, bool write) {
+    size_t expired = 0;
+    // Oldest first: ids grow with the posting order
+    while (!entries.empty() && (entries.size() > MAX_ENTRIES ||
+                                now_ms - entries.begin()->second.queued_ms > MAX_AGE_MS)) {
+        if (write) {
+            write_record(fd, RECORD_EXPIRED, encode_id(entries.begin()->first));
+        }
+        entries.erase(entries.begin());
+        expired++;
+    }
+    return expired;
+}
+
+void AlertOutbox::truncate_if_empty() {
+    if (entries.empty() && ftruncate(fd, 0) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert outbox: truncate failed");
+    }
+}
+
+bool AlertOutbox::set_file_id(uint64_t id, const std::string &file_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(id);
+    if (it == entries.end() || !it->second.file_id.empty()) {
+        return false;
+    }
+    it->second.file_id = file_id;
+    return true;
+}
+
+size_t AlertOutbox::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
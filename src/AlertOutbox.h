@@ -0,0 +1,144 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTOUTBOX_H
+#define THERMALCAM_ALERTOUTBOX_H
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Telegram alert to deliver to every recipient: a photo with a caption, or only a text message if image_path
+// is empty.
+struct Alert {
+    std::string image_path;
+    std::string text;
+    // Wall clock time of the event, identifies the alert image in the alert journal.
+    std::time_t time;
+};
+
+struct OutboxEntry {
+    uint64_t id;
+    // Wall clock time (ms since the epoch) when the alert was posted
+    int64_t queued_ms;
+    Alert alert;
+    // Chats that already received the alert
+    std::set<std::string> delivered;
+    // Chats that refused it for good (e.g. chat not found, bot blocked)
+    std::set<std::string> rejected;
+    // Telegram file_id of the photo once uploaded to a chat (not persisted)
+    std::string file_id;
+};
+
+// Persistent queue of the alerts not yet delivered to every chat. Appending only writes a record to the page
+// cache, so producers never wait on the disk or the network; the sender makes the records durable with sync()
+// and records each delivery, so alerts survive network outages and restarts until every chat received them or
+// refused them. The outbox is bounded: alerts older than MAX_AGE or beyond MAX_ENTRIES expire.
+//
+// On disk: variable length records (host byte order) with a CRC, replayed at startup. A torn tail is dropped,
+// and the file is rewritten with only the pending alerts, or truncated once nothing is pending.
+class AlertOutbox {
+
+public:
+    AlertOutbox(const std::string &path, const std::vector<std::string> &chat_ids);
+
+    virtual ~AlertOutbox();
+
+    // Replay the outbox and compact it.
+    bool open();
+
+    // Queue an alert for every chat. The record is written without waiting for the disk.
+    bool append(const Alert &alert);
+
+    // Flush the appended records to the disk.
+    void sync();
+
+    // Oldest alerts not yet delivered to the chat, at most max.
+    std::vector<OutboxEntry> pending(const std::string &chat_id, size_t max) const;
+
+    // Record the delivery of the alerts to the chat. Returns the number of alerts now done for every chat,
+    // which leave the outbox.
+    size_t delivered(const std::string &chat_id, const std::vector<uint64_t> &ids);
+
+    // Record that the chat refused the alerts and will not get them. Returns as delivered().
+    size_t rejected(const std::string &chat_id, const std::vector<uint64_t> &ids);
+
+    // Drop the alerts beyond the bounds. Returns the number dropped.
+    size_t expire(int64_t now_ms);
+
+    // Remember the file_id of the uploaded photo, the other chats get it without another upload. True the first
+    // time, to report it once.
+    bool set_file_id(uint64_t id, const std::string &file_id);
+
+    // Alerts not yet delivered to every chat.
+    size_t size() const;
+
+private:
+    static const uint32_t MAGIC = 0x4F414354; // "TCAO"
+    static const uint16_t VERSION = 1;
+    static const size_t HEADER_SIZE = 16;
+    // Larger records can only be garbage
+    static const uint32_t MAX_PAYLOAD = 64 * 1024;
+    // Bounds of the outbox, the oldest alerts expire beyond them
+    static const size_t MAX_ENTRIES = 1000;
+    static const int64_t MAX_AGE_MS = 7 * 86400 * 1000ll;
+
+    enum RecordKind : uint16_t {
+        RECORD_ALERT = 1,
+        RECORD_DELIVERED = 2,
+        // Same payload as RECORD_DELIVERED: the chat refused the alert
+        RECORD_REJECTED = 3,
+        // The alert id only
+        RECORD_EXPIRED = 4,
+    };
+
+    const std::string path;
+    const std::vector<std::string> chat_ids;
+    int fd;
+    bool dirty;
+    mutable std::mutex mutex;
+    // Pending alerts by id, ids grow with the posting order
+    std::map<uint64_t, OutboxEntry> entries;
+    uint64_t next_id;
+
+    static std::string encode_alert(const OutboxEntry &entry);
+
+    static std::string encode_delivered(uint64_t id, const std::string &chat_id);
+
+    static std::string encode_id(uint64_t id);
+
+    static bool write_record(int fd, RecordKind kind, const std::string &payload);
+
+    void apply(RecordKind kind, const std::string &payload);
+
+    bool complete(const OutboxEntry &entry) const;
+
+    size_t done(const std::string &chat_id, const std::vector<uint64_t> &ids, RecordKind kind);
+
+    // Erase the expired entries, and record it if write is set.
+    size_t expire_locked(int64_t now_ms, bool write);
+
+    void truncate_if_empty();
+
+    bool compact();
+};
+
+
+#endif //THERMALCAM_ALERTOUTBOX_H
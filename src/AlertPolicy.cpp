@@ -0,0 +1,69 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include "AlertPolicy.h"
+
+AlertPolicy::AlertPolicy(double _bucket_capacity, std::chrono::seconds _refill_interval)
+        : bucket_capacity(_bucket_capacity), refill_interval(_refill_interval) {
+    in_episode = false;
+    episode_peak = 0.0f;
+    episode_alerts = 0;
+}
+
+void AlertPolicy::observe(float temp, clock::time_point now) {
+    if (!in_episode) {
+        in_episode = true;
+        episode_start = now;
+        episode_peak = temp;
+        episode_alerts = 0;
+    }
+    episode_peak = std::max(episode_peak, temp);
+}
+
+bool AlertPolicy::on_alert(float temp, clock::time_point now) {
+    observe(temp, now);
+    episode_alerts++;
+    return episode_alerts == 1;
+}
+
+bool AlertPolicy::on_episode_end(clock::time_point now, EpisodeSummary &summary) {
+    if (!in_episode) {
+        return false;
+    }
+    in_episode = false;
+    summary.peak_temp = episode_peak;
+    summary.duration = std::chrono::duration_cast<std::chrono::seconds>(now - episode_start);
+    summary.alerts = episode_alerts;
+    return true;
+}
+
+bool AlertPolicy::allow(const std::string &chat_id, clock::time_point now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = buckets.find(chat_id);
+    if (it == buckets.end()) {
+        it = buckets.emplace(chat_id, Bucket{bucket_capacity, now}).first;
+    }
+    Bucket &bucket = it->second;
+    const double elapsed = std::chrono::duration<double>(now - bucket.updated).count();
+    bucket.tokens = std::min(bucket_capacity, bucket.tokens + elapsed / refill_interval.count());
+    bucket.updated = now;
+    if (bucket.tokens < 1.0) {
+        return false;
+    }
+    bucket.tokens -= 1.0;
+    return true;
+}
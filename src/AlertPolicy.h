@@ -0,0 +1,77 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTPOLICY_H
+#define THERMALCAM_ALERTPOLICY_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Summary of a measurement episode (one person continuously in front of the camera) that raised alerts.
+struct EpisodeSummary {
+    float peak_temp;
+    std::chrono::seconds duration;
+    int alerts;
+};
+
+// Decides which alerts are uploaded. Alerts within one measurement episode are coalesced: only the first one is
+// sent with a photo, and a summary (peak temperature, duration) is sent when the episode ends. On top of that,
+// every chat has a token bucket so a burst of episodes cannot flood a chat or get us throttled by Telegram.
+//
+// The episode methods are called from the camera thread, allow() from the dispatcher threads.
+class AlertPolicy {
+
+public:
+    typedef std::chrono::steady_clock clock;
+
+    AlertPolicy(double bucket_capacity, std::chrono::seconds refill_interval);
+
+    // A new reading while measuring.
+    void observe(float temp, clock::time_point now);
+
+    // The alert condition fired. Returns true if this alert should be captured and sent, false if it is
+    // coalesced into the current episode.
+    bool on_alert(float temp, clock::time_point now);
+
+    // The measurement ended. Returns true and fills summary if an episode was in progress.
+    bool on_episode_end(clock::time_point now, EpisodeSummary &summary);
+
+    // Take a token from the chat's bucket. Returns false if the chat is rate limited.
+    bool allow(const std::string &chat_id, clock::time_point now);
+
+private:
+    struct Bucket {
+        double tokens;
+        clock::time_point updated;
+    };
+
+    const double bucket_capacity;
+    const std::chrono::seconds refill_interval;
+
+    // Episode state, camera thread only
+    bool in_episode;
+    clock::time_point episode_start;
+    float episode_peak;
+    int episode_alerts;
+
+    std::mutex mutex;
+    std::map<std::string, Bucket> buckets;
+};
+
+
+#endif //THERMALCAM_ALERTPOLICY_H
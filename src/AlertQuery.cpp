@@ -0,0 +1,130 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include "AlertQuery.h"
+#include "AlertJournal.h"
+
+bool AlertQuery::matches(float temp) const {
+    if (std::isnan(above) && std::isnan(below)) {
+        return true;
+    }
+    return !std::isnan(temp) && (std::isnan(above) || temp > above) && (std::isnan(below) || temp < below);
+}
+
+std::string AlertQuery::encode() const {
+    // kind:from:to:above:below:limit:order, temperatures in tenths of a degree, empty when unbounded
+    auto tenths = [](float t) {
+        return std::isnan(t) ? std::string() : std::to_string(std::lround(t * 10));
+    };
+    return std::string(1, kind) + ":" + std::to_string(from) + ":" + std::to_string(to) + ":" + tenths(above) +
+           ":" + tenths(below) + ":" + std::to_string(limit) + ":" + (newest_first ? "1" : "0");
+}
+
+bool AlertQuery::decode(const std::string &text, AlertQuery &query) {
+    std::vector<std::string> fields;
+    std::stringstream ss(text);
+    std::string field;
+    while (std::getline(ss, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.size() != 7 || fields[0].size() != 1) {
+        return false;
+    }
+    try {
+        query.kind = fields[0][0];
+        query.from = std::stoll(fields[1]);
+        query.to = std::stoll(fields[2]);
+        query.above = fields[3].empty() ? NAN : std::stol(fields[3]) / 10.0f;
+        query.below = fields[4].empty() ? NAN : std::stol(fields[4]) / 10.0f;
+        query.limit = std::stoul(fields[5]);
+        query.newest_first = fields[6] == "1";
+    } catch (std::exception &) {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_date(const std::string &text, const char *format, std::tm &date) {
+    date = {};
+    std::istringstream ss(text);
+    ss >> std::get_time(&date, format);
+    if (ss.fail() || ss.peek() != std::char_traits<char>::eof()) {
+        return false;
+    }
+    date.tm_isdst = -1;
+    return true;
+}
+
+bool AlertQuery::parse(const std::string &arguments, std::time_t now, AlertQuery &query, std::string &error) {
+    query = AlertQuery();
+    query.kind = 'c';
+    std::istringstream ss(arguments);
+    std::string token;
+    int dates = 0;
+    while (ss >> token) {
+        std::replace(token.begin(), token.end(), ',', '.');
+        std::tm date = {};
+        if (token == "hoy") {
+            query.from = AlertJournal::start_of_day(now);
+            query.to = AlertJournal::start_of_next_day(now);
+        } else if (token == "mes") {
+            query.from = AlertJournal::start_of_month(now);
+            query.to = AlertJournal::start_of_next_month(now);
+        } else if ((token[0] == '>' || token[0] == '<') && token.size() > 1) {
+            char *end = nullptr;
+            const float value = std::strtof(token.c_str() + 1, &end);
+            if (*end != '\0') {
+                error = "Temperatura no válida: " + token;
+                return false;
+            }
+            (token[0] == '>' ? query.above : query.below) = value;
+        } else if (token.rfind("limite=", 0) == 0) {
+            char *end = nullptr;
+            const long value = std::strtol(token.c_str() + 7, &end, 10);
+            if (*end != '\0' || value <= 0) {
+                error = "Límite no válido: " + token;
+                return false;
+            }
+            query.limit = static_cast<size_t>(value);
+        } else if (token.size() == 10 && parse_date(token, "%Y-%m-%d", date)) {
+            const std::time_t day = mktime(&date);
+            if (dates == 0) {
+                query.from = AlertJournal::start_of_day(day);
+            }
+            // A second date closes the range, both days included
+            query.to = AlertJournal::start_of_next_day(day);
+            dates++;
+        } else if (token.size() == 7 && parse_date(token, "%Y-%m", date)) {
+            date.tm_mday = 1;
+            const std::time_t month = mktime(&date);
+            query.from = AlertJournal::start_of_month(month);
+            query.to = AlertJournal::start_of_next_month(month);
+        } else {
+            error = "No se entiende: " + token;
+            return false;
+        }
+    }
+    if (dates > 2 || (query.to != 0 && query.to <= query.from)) {
+        error = "Rango de fechas no válido";
+        return false;
+    }
+    return true;
+}
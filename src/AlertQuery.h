@@ -0,0 +1,52 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTQUERY_H
+#define THERMALCAM_ALERTQUERY_H
+
+#include <cmath>
+#include <cstddef>
+#include <ctime>
+#include <string>
+
+// Query over the alert journal, shared by the bot commands and the inline buttons.
+struct AlertQuery {
+    // Selects the reply texts: 't' all alerts, 'd' today, 'm' this month, 'u' latest, 'c' custom (/alertas)
+    char kind = 't';
+    // Time range, from <= time < to; to == 0 means no upper bound
+    std::time_t from = 0;
+    std::time_t to = 0;
+    // Only alerts strictly above / below these temperatures, NAN for no bound. Alerts without a recorded
+    // temperature never match a bound.
+    float above = NAN;
+    float below = NAN;
+    // Maximum number of alerts, 0 for no limit
+    size_t limit = 0;
+    bool newest_first = false;
+
+    bool matches(float temp) const;
+
+    // Compact text form, short enough for Telegram callback data (64 bytes), and its inverse.
+    std::string encode() const;
+
+    static bool decode(const std::string &text, AlertQuery &query);
+
+    // Parse the arguments of /alertas: [hoy | mes | YYYY-MM | YYYY-MM-DD [YYYY-MM-DD]] [>T] [<T] [limite=N]
+    static bool parse(const std::string &arguments, std::time_t now, AlertQuery &query, std::string &error);
+};
+
+
+#endif //THERMALCAM_ALERTQUERY_H
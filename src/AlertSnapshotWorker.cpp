@@ -0,0 +1,80 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <SDL2/SDL.h>
+#include "AlertSnapshotWorker.h"
+#include "AlertClip.h"
+
+AlertSnapshotWorker::AlertSnapshotWorker(PathFor _path_for) : path_for(std::move(_path_for)), stopping(false) {
+    thread = std::thread(&AlertSnapshotWorker::run, this);
+}
+
+AlertSnapshotWorker::~AlertSnapshotWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+bool AlertSnapshotWorker::submit(std::unique_ptr<AlertSnapshot> snapshot, Callback done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= MAX_QUEUE) {
+            return false;
+        }
+        queue.push_back({std::move(snapshot), std::move(done)});
+    }
+    cv.notify_one();
+    return true;
+}
+
+void AlertSnapshotWorker::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            // Pending snapshots are still written when stopping.
+            if (queue.empty()) {
+                return;
+            }
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        const AlertSnapshot &snapshot = *job.snapshot;
+        Rasterizer raster(snapshot.width, snapshot.height);
+        render_alert_image(snapshot, raster);
+        std::string path = path_for(snapshot);
+        if (!save_png(raster, path)) {
+            // The alert still goes out, without an image
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to write alert image %s", path.c_str());
+            path.clear();
+        } else {
+            if (!save_alert_derivatives(raster, path)) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to write preview of %s", path.c_str());
+            }
+            if (!snapshot.clip.empty() &&
+                !save_alert_clip(snapshot.clip, snapshot.clip_trigger, alert_clip_path(path))) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to write clip of %s", path.c_str());
+            }
+        }
+        if (job.done) {
+            job.done(snapshot, path);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTSNAPSHOTWORKER_H
+#define THERMALCAM_ALERTSNAPSHOTWORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "AlertImage.h"
+
+// Background thread that renders alert snapshots and writes them as PNG plus preview, thumbnail and clip, so
+// the camera loop never waits on a framebuffer readback, the encoders or the SD card.
+class AlertSnapshotWorker {
+
+public:
+    // Called on the worker thread once the image is on disk, with an empty path if it could not be written.
+    typedef std::function<void(const AlertSnapshot &snapshot, const std::string &path)> Callback;
+    // Chooses the file an image is written to.
+    typedef std::function<std::string(const AlertSnapshot &snapshot)> PathFor;
+
+    explicit AlertSnapshotWorker(PathFor path_for);
+
+    virtual ~AlertSnapshotWorker();
+
+    // Queue a snapshot without blocking. Returns false (and drops the snapshot) if the queue is full.
+    bool submit(std::unique_ptr<AlertSnapshot> snapshot, Callback done);
+
+private:
+    static const size_t MAX_QUEUE = 8;
+
+    struct Job {
+        std::unique_ptr<AlertSnapshot> snapshot;
+        Callback done;
+    };
+
+    const PathFor path_for;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> queue;
+    bool stopping;
+    std::thread thread;
+
+    void run();
+};
+
+
+#endif //THERMALCAM_ALERTSNAPSHOTWORKER_H
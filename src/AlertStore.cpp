@@ -0,0 +1,103 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <filesystem>
+#include <SDL2/SDL.h>
+#include "AlertStore.h"
+#include "AlertImage.h"
+#include "Metrics.h"
+
+AlertStore::AlertStore(const std::string &_root, AlertJournal &_journal, uint64_t _max_bytes,
+                       std::chrono::hours _max_age) : root(_root), journal(_journal), max_bytes(_max_bytes),
+                                                      max_age(_max_age), evicted(0) {
+}
+
+std::string AlertStore::path_for(std::time_t time, const std::string &extension) const {
+    std::tm local = {};
+    localtime_r(&time, &local);
+    char day[16];
+    strftime(day, sizeof(day), "%Y/%m/%d", &local);
+    const std::filesystem::path folder = std::filesystem::path(root) / day;
+    std::error_code error;
+    std::filesystem::create_directories(folder, error);
+    if (error) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to create %s: %s", folder.c_str(), error.message().c_str());
+    }
+    return (folder / (alert_file_stem(time) + extension)).string();
+}
+
+bool AlertStore::add(std::time_t time, float temp, float ambient, const std::string &path) {
+    if (!journal.append({time, temp, ambient, path, AlertJournal::files_size(path)})) {
+        return false;
+    }
+    enforce();
+    return true;
+}
+
+void AlertStore::enforce() {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::time_t oldest_allowed =
+            std::time(nullptr) - std::chrono::duration_cast<std::chrono::seconds>(max_age).count();
+    const size_t evicted_before = evicted;
+    AlertEntry oldest;
+    // Never evict the only alert left, /alertault must keep working.
+    while (journal.size() > 1 && journal.oldest(oldest) &&
+           (journal.total_bytes() > max_bytes || oldest.time < oldest_allowed)) {
+        evict_oldest();
+    }
+    if (evicted != evicted_before) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Alert store: evicted %zu alerts, %zu alerts use %.1f MB",
+                    evicted - evicted_before, journal.size(), journal.total_bytes() / 1048576.0);
+    }
+    update_metrics();
+}
+
+void AlertStore::evict_oldest() {
+    AlertEntry entry;
+    if (!journal.pop_oldest(entry)) {
+        return;
+    }
+    std::error_code error;
+    for (const std::string &file : alert_files(entry.path)) {
+        // Images stored before the derivatives existed have none.
+        if (!std::filesystem::remove(file, error) && error) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to remove %s: %s", file.c_str(),
+                         error.message().c_str());
+        }
+    }
+    // Drop the day, month and year directories once they are empty; remove() fails on a non-empty one.
+    std::filesystem::path folder = std::filesystem::path(entry.path).parent_path();
+    while (entry.path.compare(0, root.size(), root) == 0 && folder.string().size() > root.size() &&
+           std::filesystem::remove(folder, error)) {
+        folder = folder.parent_path();
+    }
+    evicted++;
+    Metrics::instance().add("alert_store_evictions_total");
+}
+
+uint64_t AlertStore::usage_bytes() const {
+    return journal.total_bytes();
+}
+
+size_t AlertStore::evictions() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return evicted;
+}
+
+void AlertStore::update_metrics() const {
+    Metrics::instance().set("alert_store_bytes", static_cast<double>(journal.total_bytes()));
+    Metrics::instance().set("alert_store_files", static_cast<double>(journal.size()));
+}
@@ -0,0 +1,61 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALERTSTORE_H
+#define THERMALCAM_ALERTSTORE_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include "AlertJournal.h"
+
+// Bounded storage of the alert images. Files are laid out as root/YYYY/MM/DD/<stem>.<ext> so no directory grows
+// without limit, and the oldest alerts are evicted, in journal order, once the byte or age budget is exceeded.
+class AlertStore {
+
+public:
+    AlertStore(const std::string &root, AlertJournal &journal, uint64_t max_bytes, std::chrono::hours max_age);
+
+    // Path for a new image taken at the given time. Creates the date directory.
+    std::string path_for(std::time_t time, const std::string &extension) const;
+
+    // Record an image that was written to disk and enforce the budget.
+    bool add(std::time_t time, float temp, float ambient, const std::string &path);
+
+    // Evict the oldest alerts until the store is within its byte and age budget.
+    void enforce();
+
+    uint64_t usage_bytes() const;
+
+    size_t evictions() const;
+
+private:
+    const std::string root;
+    AlertJournal &journal;
+    const uint64_t max_bytes;
+    const std::chrono::hours max_age;
+    mutable std::mutex mutex;
+    size_t evicted;
+
+    void evict_oldest();
+
+    void update_metrics() const;
+};
+
+
+#endif //THERMALCAM_ALERTSTORE_H
@@ -0,0 +1,126 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <exception>
+#include <SDL2/SDL.h>
+#include "BotExecutor.h"
+#include "Metrics.h"
+
+BotExecutor::BotExecutor(size_t threads) : pending(0), stopping(false) {
+    for (size_t i = 0; i < std::max<size_t>(1, threads); i++) {
+        workers.emplace_back(&BotExecutor::run, this);
+    }
+}
+
+BotExecutor::~BotExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (auto &chat : chats) {
+            if (chat.second.running_cancelled) {
+                *chat.second.running_cancelled = true;
+            }
+        }
+    }
+    cv.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void BotExecutor::submit(std::int64_t chat_id, const std::string &key, Handler handler) {
+    size_t superseded = 0;
+    size_t depth;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ChatQueue &chat = chats[chat_id];
+        const size_t before = chat.tasks.size();
+        chat.tasks.erase(std::remove_if(chat.tasks.begin(), chat.tasks.end(), [&key](const Task &task) {
+            return task.key == key;
+        }), chat.tasks.end());
+        superseded = before - chat.tasks.size();
+        pending -= superseded;
+        if (chat.active && chat.running_key == key && chat.running_cancelled) {
+            *chat.running_cancelled = true;
+            superseded++;
+        }
+        if (!chat.scheduled) {
+            ready.push_back(chat_id);
+            chat.scheduled = true;
+        }
+        chat.tasks.push_back({key, std::move(handler), std::chrono::steady_clock::now(),
+                              std::make_shared<std::atomic<bool>>(false)});
+        depth = ++pending;
+    }
+    Metrics::instance().set("bot_queue_depth", static_cast<double>(depth));
+    if (superseded > 0) {
+        Metrics::instance().add("bot_commands_superseded_total", static_cast<double>(superseded));
+    }
+    cv.notify_one();
+}
+
+void BotExecutor::run() {
+    while (true) {
+        std::int64_t chat_id;
+        Task task;
+        size_t depth;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !ready.empty(); });
+            if (stopping) {
+                return;
+            }
+            chat_id = ready.front();
+            ready.pop_front();
+            ChatQueue &chat = chats[chat_id];
+            task = std::move(chat.tasks.front());
+            chat.tasks.pop_front();
+            chat.active = true;
+            chat.running_key = task.key;
+            chat.running_cancelled = task.cancelled;
+            depth = --pending;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        Metrics::instance().set("bot_queue_depth", static_cast<double>(depth));
+        Metrics::instance().set("bot_command_wait_ms",
+                                std::chrono::duration<double, std::milli>(start - task.queued).count());
+        const std::shared_ptr<std::atomic<bool>> cancelled = task.cancelled;
+        try {
+            task.handler([cancelled] { return cancelled->load(); });
+        } catch (std::exception &e) {
+            Metrics::instance().add("bot_commands_failed_total");
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Bot command %s failed: %s", task.key.c_str(), e.what());
+        }
+        Metrics::instance().set("bot_command_duration_ms", std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count());
+        Metrics::instance().add("bot_commands_total");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ChatQueue &chat = chats[chat_id];
+            chat.active = false;
+            chat.running_key.clear();
+            chat.running_cancelled.reset();
+            if (chat.tasks.empty()) {
+                chats.erase(chat_id);
+            } else {
+                // Back of the line, so a chat with many queued commands does not starve the others
+                ready.push_back(chat_id);
+                cv.notify_one();
+            }
+        }
+    }
+}
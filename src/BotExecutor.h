@@ -0,0 +1,82 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_BOTEXECUTOR_H
+#define THERMALCAM_BOTEXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Worker pool for the bot command handlers, so a slow reply (e.g. a history upload) never stalls long polling
+// or the other chats.
+//
+// Handlers of one chat run in submission order, one at a time; different chats run in parallel. A handler
+// submitted with the same key as one that is still queued or running for the chat supersedes it: the queued
+// one is dropped, the running one sees its cancelled() turn true and should stop at the next send.
+class BotExecutor {
+
+public:
+    typedef std::function<bool()> Cancelled;
+    typedef std::function<void(const Cancelled &cancelled)> Handler;
+
+    explicit BotExecutor(size_t threads);
+
+    virtual ~BotExecutor();
+
+    void submit(std::int64_t chat_id, const std::string &key, Handler handler);
+
+private:
+    struct Task {
+        std::string key;
+        Handler handler;
+        std::chrono::steady_clock::time_point queued;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    struct ChatQueue {
+        std::deque<Task> tasks;
+        // The chat is in ready or a worker is running one of its tasks
+        bool scheduled = false;
+        // A worker is running a task of this chat
+        bool active = false;
+        std::string running_key;
+        std::shared_ptr<std::atomic<bool>> running_cancelled;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<std::int64_t, ChatQueue> chats;
+    // Chats with queued tasks and no active worker, served in turn
+    std::deque<std::int64_t> ready;
+    size_t pending;
+    bool stopping;
+    std::vector<std::thread> workers;
+
+    void run();
+};
+
+
+#endif //THERMALCAM_BOTEXECUTOR_H
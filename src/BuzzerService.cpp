@@ -0,0 +1,184 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <SDL2/SDL.h>
+#ifndef THERMALCAM_STUB_GPIO
+#include <pigpio.h>
+#endif
+#include "BuzzerService.h"
+
+static const BuzzerPattern ALL_PATTERNS[] = {BuzzerPattern::ALERT, BuzzerPattern::BEEP};
+
+BuzzerSteps buzzer_steps(BuzzerPattern pattern) {
+    switch (pattern) {
+        case BuzzerPattern::ALERT: {
+            BuzzerSteps steps;
+            for (int i = 0; i < 2; i++) {
+                steps.emplace_back(50000, 50000);
+                steps.emplace_back(50000, 50000);
+                steps.emplace_back(50000, 50000);
+                steps.emplace_back(50000, 1000000);
+            }
+            return steps;
+        }
+        case BuzzerPattern::BEEP:
+            return {{100000, 0}};
+    }
+    return {};
+}
+
+static std::chrono::microseconds duration(BuzzerPattern pattern) {
+    std::chrono::microseconds total(0);
+    for (const auto &step : buzzer_steps(pattern)) {
+        total += std::chrono::microseconds(step.first + step.second);
+    }
+    return total;
+}
+
+// ------------------------------------------------------------------------------------------------ pigpio
+
+PigpioBuzzerBackend::PigpioBuzzerBackend(unsigned _pin) : pin(_pin), initialised(false) {
+}
+
+#ifndef THERMALCAM_STUB_GPIO
+bool PigpioBuzzerBackend::init() {
+    if (gpioInitialise() < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Failed to initialize pigpio library.");
+        return false;
+    }
+    initialised = true;
+    gpioSetMode(pin, PI_OUTPUT);
+    gpioWrite(pin, 0);
+    // Build one waveform per pattern.
+    for (BuzzerPattern pattern : ALL_PATTERNS) {
+        std::vector<gpioPulse_t> pulses;
+        for (const auto &step : buzzer_steps(pattern)) {
+            pulses.push_back({1u << pin, 0, step.first});
+            if (step.second > 0) {
+                pulses.push_back({0, 1u << pin, step.second});
+            }
+        }
+        pulses.push_back({0, 1u << pin, 0});
+        gpioWaveAddNew();
+        gpioWaveAddGeneric(pulses.size(), pulses.data());
+        const int wave_id = gpioWaveCreate();
+        if (wave_id < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "gpioWaveCreate() failed: %d", wave_id);
+        }
+        wave_ids.push_back(wave_id);
+    }
+    return true;
+}
+
+void PigpioBuzzerBackend::play(BuzzerPattern pattern) {
+    const int wave_id = wave_ids.at(static_cast<size_t>(pattern));
+    if (wave_id >= 0) {
+        gpioWaveTxSend(wave_id, PI_WAVE_MODE_ONE_SHOT);
+    }
+}
+
+void PigpioBuzzerBackend::shutdown() {
+    if (!initialised) {
+        return;
+    }
+    gpioWaveTxStop();
+    for (int wave_id : wave_ids) {
+        if (wave_id >= 0) {
+            gpioWaveDelete(wave_id);
+        }
+    }
+    wave_ids.clear();
+    gpioWrite(pin, 0);
+    gpioTerminate();
+    initialised = false;
+}
+#else
+bool PigpioBuzzerBackend::init() {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Built without pigpio (THERMALCAM_STUB_GPIO)");
+    return false;
+}
+
+void PigpioBuzzerBackend::play(BuzzerPattern) {
+}
+
+void PigpioBuzzerBackend::shutdown() {
+}
+#endif
+
+// ------------------------------------------------------------------------------------------------ stub
+
+bool StubBuzzerBackend::init() {
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Buzzer: using stub backend");
+    return true;
+}
+
+void StubBuzzerBackend::play(BuzzerPattern pattern) {
+    n_played++;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Buzzer: pattern %d (%lld ms)", static_cast<int>(pattern),
+                static_cast<long long>(duration(pattern).count() / 1000));
+}
+
+void StubBuzzerBackend::shutdown() {
+}
+
+// ------------------------------------------------------------------------------------------------ service
+
+BuzzerService::BuzzerService(std::unique_ptr<BuzzerBackend> _backend) : backend(std::move(_backend)),
+                                                                        stopping(false) {
+    if (!backend->init()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Buzzer: falling back to stub backend");
+        backend.reset(new StubBuzzerBackend());
+        backend->init();
+    }
+    thread = std::thread(&BuzzerService::run, this);
+}
+
+BuzzerService::~BuzzerService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+    backend->shutdown();
+}
+
+bool BuzzerService::request(BuzzerPattern pattern) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.size() >= MAX_QUEUE) {
+            return false;
+        }
+        queue.push_back(pattern);
+    }
+    cv.notify_all();
+    return true;
+}
+
+void BuzzerService::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        BuzzerPattern pattern = queue.front();
+        queue.pop_front();
+        backend->play(pattern);
+        // The pattern plays in hardware; just don't start the next one before it ends.
+        cv.wait_for(lock, duration(pattern), [this] { return stopping; });
+    }
+}
@@ -0,0 +1,119 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_BUZZERSERVICE_H
+#define THERMALCAM_BUZZERSERVICE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+enum class BuzzerPattern {
+    // Two bursts of four short beeps, as the original soundBuzzer()
+    ALERT,
+    // One short beep
+    BEEP,
+};
+
+// A pattern as (on, off) durations in microseconds.
+typedef std::vector<std::pair<uint32_t, uint32_t>> BuzzerSteps;
+
+BuzzerSteps buzzer_steps(BuzzerPattern pattern);
+
+// Hardware access for the buzzer service.
+class BuzzerBackend {
+
+public:
+    virtual ~BuzzerBackend() = default;
+
+    virtual bool init() = 0;
+
+    // Start playing a pattern without blocking. The previous pattern has finished.
+    virtual void play(BuzzerPattern pattern) = 0;
+
+    virtual void shutdown() = 0;
+};
+
+// Plays the patterns as pigpio waveforms: they are built once at init and transmitted by DMA, so no thread
+// toggles the pin or sleeps between edges.
+class PigpioBuzzerBackend : public BuzzerBackend {
+
+public:
+    explicit PigpioBuzzerBackend(unsigned pin);
+
+    bool init() override;
+
+    void play(BuzzerPattern pattern) override;
+
+    void shutdown() override;
+
+private:
+    const unsigned pin;
+    bool initialised;
+    std::vector<int> wave_ids;
+};
+
+// Backend for hosts without GPIO: only logs and counts the requested patterns.
+class StubBuzzerBackend : public BuzzerBackend {
+
+public:
+    bool init() override;
+
+    void play(BuzzerPattern pattern) override;
+
+    void shutdown() override;
+
+    size_t played() const { return n_played; }
+
+private:
+    size_t n_played = 0;
+};
+
+// Long-lived actuator service. GPIO is initialised once; patterns are requested through a small non-blocking
+// queue and played one after the other. Requests arriving while the queue is full are dropped, overlapping
+// alerts only need one buzz.
+class BuzzerService {
+
+public:
+    explicit BuzzerService(std::unique_ptr<BuzzerBackend> backend);
+
+    virtual ~BuzzerService();
+
+    // Returns false if the request was dropped.
+    bool request(BuzzerPattern pattern);
+
+private:
+    static const size_t MAX_QUEUE = 2;
+
+    std::unique_ptr<BuzzerBackend> backend;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<BuzzerPattern> queue;
+    bool stopping;
+    std::thread thread;
+
+    void run();
+};
+
+
+#endif //THERMALCAM_BUZZERSERVICE_H
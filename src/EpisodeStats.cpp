@@ -0,0 +1,158 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include "EpisodeStats.h"
+
+float StatsBucket::percentile(double fraction) const {
+    if (visitors == 0) {
+        return NAN;
+    }
+    const double target = std::max(1.0, std::ceil(fraction * visitors));
+    uint64_t seen = 0;
+    for (int i = 0; i < TEMP_BINS; i++) {
+        seen += temp_bins[i];
+        if (seen >= target) {
+            return TEMP_MIN + (i + 0.5f) * TEMP_STEP;
+        }
+    }
+    return TEMP_MIN + TEMP_BINS * TEMP_STEP;
+}
+
+int StatsBucket::peak_hour() const {
+    if (visitors == 0) {
+        return -1;
+    }
+    return static_cast<int>(std::max_element(hours, hours + 24) - hours);
+}
+
+EpisodeStats::EpisodeStats(const std::string &_path) : path(_path), fd(-1), stats(nullptr) {
+}
+
+EpisodeStats::~EpisodeStats() {
+    if (stats != nullptr) {
+        munmap(stats, sizeof(StatsFile));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool EpisodeStats::open() {
+    std::lock_guard<std::mutex> lock(mutex);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info = {};
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open statistics %s", path.c_str());
+        return false;
+    }
+    const bool fresh = static_cast<size_t>(info.st_size) != sizeof(StatsFile);
+    if (fresh && (ftruncate(fd, 0) != 0 || posix_fallocate(fd, 0, sizeof(StatsFile)) != 0)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to allocate statistics %s", path.c_str());
+        return false;
+    }
+    void *mapping = mmap(nullptr, sizeof(StatsFile), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to map statistics %s", path.c_str());
+        return false;
+    }
+    stats = static_cast<StatsFile *>(mapping);
+    if (fresh || stats->magic != MAGIC || stats->version != VERSION) {
+        memset(mapping, 0, sizeof(StatsFile));
+        stats->version = VERSION;
+        stats->magic = MAGIC;
+    }
+    return true;
+}
+
+static uint32_t day_key(const std::tm &local) {
+    return static_cast<uint32_t>((local.tm_year + 1900) * 10000 + (local.tm_mon + 1) * 100 + local.tm_mday);
+}
+
+static uint32_t month_key(const std::tm &local) {
+    return static_cast<uint32_t>((local.tm_year + 1900) * 100 + local.tm_mon + 1);
+}
+
+// Slots: consecutive days and months never share one. Days are counted from the civil date, without mktime().
+static int day_slot(const std::tm &local) {
+    const int year = local.tm_year + 1900 - (local.tm_mon < 2 ? 1 : 0);
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int year_of_era = year - era * 400;
+    const int day_of_year = (153 * (local.tm_mon + (local.tm_mon < 2 ? 10 : -2)) + 2) / 5 + local.tm_mday - 1;
+    const long days = era * 146097L + year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return static_cast<int>(days % EpisodeStats::DAYS);
+}
+
+static int month_slot(const std::tm &local) {
+    return ((local.tm_year + 1900) * 12 + local.tm_mon) % EpisodeStats::MONTHS;
+}
+
+void EpisodeStats::add_to(StatsBucket &bucket, uint32_t key, const EpisodeSummary &episode, int hour) {
+    if (bucket.key != key) {
+        // The slot held a day or month that is now out of the retention
+        memset(&bucket, 0, sizeof(bucket));
+        bucket.key = key;
+        bucket.max_temp = NAN;
+    }
+    bucket.visitors++;
+    bucket.alert_visitors += episode.alerts > 0 ? 1 : 0;
+    bucket.alerts += static_cast<uint32_t>(episode.alerts);
+    bucket.measured_seconds += static_cast<uint64_t>(std::max<long long>(0, episode.duration.count()));
+    bucket.max_temp = std::isnan(bucket.max_temp) ? episode.peak_temp : std::max(bucket.max_temp, episode.peak_temp);
+    bucket.hours[hour]++;
+    const long bin = std::lround(std::floor((episode.peak_temp - StatsBucket::TEMP_MIN) / StatsBucket::TEMP_STEP));
+    bucket.temp_bins[std::min<long>(StatsBucket::TEMP_BINS - 1, std::max(0L, bin))]++;
+}
+
+void EpisodeStats::add(const EpisodeSummary &episode, std::time_t end_time) {
+    std::tm local = {};
+    localtime_r(&end_time, &local);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stats == nullptr) {
+        return;
+    }
+    add_to(stats->days[day_slot(local)], day_key(local), episode, local.tm_hour);
+    add_to(stats->months[month_slot(local)], month_key(local), episode, local.tm_hour);
+}
+
+bool EpisodeStats::day(std::time_t t, StatsBucket &bucket) const {
+    std::tm local = {};
+    localtime_r(&t, &local);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stats == nullptr || stats->days[day_slot(local)].key != day_key(local)) {
+        return false;
+    }
+    bucket = stats->days[day_slot(local)];
+    return true;
+}
+
+bool EpisodeStats::month(std::time_t t, StatsBucket &bucket) const {
+    std::tm local = {};
+    localtime_r(&t, &local);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stats == nullptr || stats->months[month_slot(local)].key != month_key(local)) {
+        return false;
+    }
+    bucket = stats->months[month_slot(local)];
+    return true;
+}
@@ -0,0 +1,95 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_EPISODESTATS_H
+#define THERMALCAM_EPISODESTATS_H
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include "AlertPolicy.h"
+
+// Running aggregates of the measurement episodes of one day or one month.
+struct StatsBucket {
+    static const int TEMP_BINS = 130;
+    static constexpr float TEMP_MIN = 30.0f;
+    static constexpr float TEMP_STEP = 0.1f;
+
+    // YYYYMMDD or YYYYMM, 0 if the bucket is empty
+    uint32_t key;
+    // Episodes, i.e. people measured
+    uint32_t visitors;
+    // Episodes that raised alerts, and the alerts raised
+    uint32_t alert_visitors;
+    uint32_t alerts;
+    uint64_t measured_seconds;
+    float max_temp;
+    // Visitors by local hour
+    uint32_t hours[24];
+    // Peak temperature of each visitor, in TEMP_STEP bins from TEMP_MIN (the first and last bins are open ended)
+    uint32_t temp_bins[TEMP_BINS];
+
+    // Temperature below which the given fraction of the visitors peaked (center of the bin), NAN if empty.
+    float percentile(double fraction) const;
+
+    // Hour with the most visitors, -1 if empty.
+    int peak_hour() const;
+};
+
+// Daily and monthly statistics (the last DAYS days and MONTHS months), updated when an episode ends so a report
+// is a copy of one bucket, whatever the history. Stored in a memory mapped file that survives restarts.
+class EpisodeStats {
+
+public:
+    static const int DAYS = 32;
+    static const int MONTHS = 13;
+
+    explicit EpisodeStats(const std::string &path);
+
+    virtual ~EpisodeStats();
+
+    bool open();
+
+    // Camera thread, when a measurement episode ends.
+    void add(const EpisodeSummary &episode, std::time_t end_time);
+
+    // Statistics of the day or month containing t. False if there are none (nothing measured or too old).
+    bool day(std::time_t t, StatsBucket &bucket) const;
+
+    bool month(std::time_t t, StatsBucket &bucket) const;
+
+private:
+    static const uint32_t MAGIC = 0x53454354; // "TCES"
+    static const uint32_t VERSION = 1;
+
+    struct StatsFile {
+        uint32_t magic;
+        uint32_t version;
+        StatsBucket days[DAYS];
+        StatsBucket months[MONTHS];
+    };
+
+    const std::string path;
+    int fd;
+    StatsFile *stats;
+    mutable std::mutex mutex;
+
+    static void add_to(StatsBucket &bucket, uint32_t key, const EpisodeSummary &episode, int hour);
+};
+
+
+#endif //THERMALCAM_EPISODESTATS_H
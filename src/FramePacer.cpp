@@ -0,0 +1,115 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <SDL2/SDL.h>
+#include "FramePacer.h"
+
+using namespace std::chrono;
+
+const long FramePacer::BUCKET_LIMITS_US[FramePacer::N_BUCKETS - 1] = {100, 250, 500, 1000, 2000, 5000, 10000};
+
+FramePacer::FramePacer(microseconds _period, microseconds _guard) : nominal_period(_period), guard(_guard) {
+    period_us = static_cast<double>(_period.count());
+    has_deadline = false;
+    has_ready = false;
+    std::fill(histogram, histogram + N_BUCKETS, 0);
+    frames = 0;
+    missed_deadlines = 0;
+    max_lateness_us = 0;
+    report_time = clock::now();
+}
+
+void FramePacer::frame_read(clock::time_point read_start, clock::time_point data_ready, bool waited) {
+    // Time spent waiting for the sensor to flag new data.
+    const double blocked_us = waited ? duration<double, std::micro>(data_ready - read_start).count() : 0.0;
+    if (waited) {
+        // We saw the data-ready edge, so the sensor's clock can be measured.
+        if (has_ready) {
+            const double interval_us = duration<double, std::micro>(data_ready - last_ready).count();
+            const double nominal_us = static_cast<double>(nominal_period.count());
+            if (interval_us > 0.5 * nominal_us && interval_us < 1.5 * nominal_us) {
+                period_us += PERIOD_GAIN * (interval_us - period_us);
+                period_us = std::min(std::max(period_us, (1 - PERIOD_TOLERANCE) * nominal_us),
+                                     (1 + PERIOD_TOLERANCE) * nominal_us);
+            }
+        }
+        last_ready = data_ready;
+        has_ready = true;
+    } else {
+        has_ready = false;
+    }
+    // Phase lock: aim to wake up `guard` before the data is ready. When the data was already there we do not
+    // know by how much we were late, so step the next deadline earlier by a fixed fraction of the period.
+    const double error_us = blocked_us - static_cast<double>(guard.count());
+    const double correction_us = waited ? std::min(std::max(PHASE_GAIN * error_us, -period_us / 4), period_us / 4)
+                                        : -period_us / 8;
+    if (!has_deadline) {
+        deadline = read_start;
+        has_deadline = true;
+    }
+    deadline += duration_cast<clock::duration>(duration<double, std::micro>(period_us + correction_us));
+}
+
+void FramePacer::wait() {
+    clock::time_point now = clock::now();
+    if (!has_deadline) {
+        deadline = now;
+        has_deadline = true;
+    }
+    const duration<double, std::micro> late = now - deadline;
+    if (late.count() > period_us / 2) {
+        // The iteration overran: drop the missed deadlines and stay on the grid.
+        const auto missed = static_cast<size_t>(std::ceil(late.count() / period_us));
+        deadline += duration_cast<clock::duration>(duration<double, std::micro>(missed * period_us));
+        missed_deadlines += missed;
+    }
+    if (deadline > now) {
+        std::this_thread::sleep_until(deadline);
+        now = clock::now();
+    }
+    const long lateness_us = duration_cast<microseconds>(now - deadline).count();
+    int bucket = 0;
+    while (bucket < N_BUCKETS - 1 && lateness_us >= BUCKET_LIMITS_US[bucket]) {
+        bucket++;
+    }
+    histogram[bucket]++;
+    max_lateness_us = std::max(max_lateness_us, lateness_us);
+    frames++;
+}
+
+void FramePacer::report() {
+    const clock::time_point now = clock::now();
+    if (now - report_time < minutes(1)) {
+        return;
+    }
+    std::string buckets;
+    for (int i = 0; i < N_BUCKETS; i++) {
+        buckets += (i < N_BUCKETS - 1 ? "<" + std::to_string(BUCKET_LIMITS_US[i]) : ">=" +
+                std::to_string(BUCKET_LIMITS_US[N_BUCKETS - 2])) + "us:" + std::to_string(histogram[i]) + " ";
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Frame pacing: %zu frames, %zu missed deadlines, period %.1f us, max lateness %ld us, lateness %s",
+                frames, missed_deadlines, period_us, max_lateness_us, buckets.c_str());
+    std::fill(histogram, histogram + N_BUCKETS, 0);
+    frames = 0;
+    missed_deadlines = 0;
+    max_lateness_us = 0;
+    report_time = now;
+}
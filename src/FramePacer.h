@@ -0,0 +1,72 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMEPACER_H
+#define THERMALCAM_FRAMEPACER_H
+
+#include <chrono>
+#include <cstddef>
+
+// Paces the main loop against absolute deadlines on steady_clock, phase-locked to the moment the sensor
+// has a new subpage ready. The sensor runs on its own oscillator, so the period is re-estimated from the
+// observed data-ready intervals instead of trusting FRAME_TIME_MICROS.
+class FramePacer {
+
+public:
+    typedef std::chrono::steady_clock clock;
+
+    FramePacer(std::chrono::microseconds period, std::chrono::microseconds guard);
+
+    // Report one sensor read: read_start is when the loop started waiting for the sensor, data_ready when the
+    // sensor flagged new data. waited is false if the data was already there on the first poll, in which case
+    // the actual data-ready moment is unknown (earlier than read_start).
+    void frame_read(clock::time_point read_start, clock::time_point data_ready, bool waited);
+
+    // Sleep until the next deadline. Deadlines that already passed are skipped (and counted) instead of
+    // sleeping a negative amount or running several iterations back to back.
+    void wait();
+
+    // Log the lateness histogram once per report interval.
+    void report();
+
+private:
+    // Upper bounds (microseconds) of the lateness histogram buckets, the last bucket is open ended.
+    static const int N_BUCKETS = 8;
+    static const long BUCKET_LIMITS_US[N_BUCKETS - 1];
+    // Fraction of the phase error corrected per frame.
+    static constexpr double PHASE_GAIN = 0.25;
+    // Weight of a new interval in the period estimate.
+    static constexpr double PERIOD_GAIN = 0.125;
+    // The period estimate is kept within this fraction of the nominal period.
+    static constexpr double PERIOD_TOLERANCE = 0.05;
+
+    const std::chrono::microseconds nominal_period;
+    const std::chrono::microseconds guard;
+    double period_us;
+    bool has_deadline;
+    clock::time_point deadline;
+    bool has_ready;
+    clock::time_point last_ready;
+
+    size_t histogram[N_BUCKETS];
+    size_t frames;
+    size_t missed_deadlines;
+    long max_lateness_us;
+    clock::time_point report_time;
+};
+
+
+#endif //THERMALCAM_FRAMEPACER_H
@@ -0,0 +1,35 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "FrameRing.h"
+
+FrameRing::FrameRing(size_t capacity) : slots(capacity), next(0), count(0) {
+}
+
+void FrameRing::push(const Measurement &measurement) {
+    slots[next] = measurement;
+    next = (next + 1) % slots.size();
+    count = count < slots.size() ? count + 1 : count;
+}
+
+void FrameRing::copy_since(uint64_t first_frame, std::vector<Measurement> &frames) const {
+    for (size_t i = 0; i < count; i++) {
+        const Measurement &measurement = slots[(next + slots.size() - count + i) % slots.size()];
+        if (measurement.frame_no >= first_frame) {
+            frames.push_back(measurement);
+        }
+    }
+}
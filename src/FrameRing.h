@@ -0,0 +1,47 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMERING_H
+#define THERMALCAM_FRAMERING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "LiveMeasurement.h"
+
+// The last frames of the camera loop, so an alert can keep the frames that led up to it. All slots are
+// allocated up front; pushing a frame only copies it over the oldest one. Camera thread only.
+class FrameRing {
+
+public:
+    explicit FrameRing(size_t capacity);
+
+    void push(const Measurement &measurement);
+
+    // Append the frames with frame_no >= first_frame that are still in the ring, oldest first.
+    void copy_since(uint64_t first_frame, std::vector<Measurement> &frames) const;
+
+    size_t size() const { return count; }
+
+private:
+    std::vector<Measurement> slots;
+    // Slot the next frame is written to
+    size_t next;
+    size_t count;
+};
+
+
+#endif //THERMALCAM_FRAMERING_H
@@ -0,0 +1,63 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstring>
+#include <thread>
+#include "LiveMeasurement.h"
+
+LiveMeasurement::LiveMeasurement() : sequence(0) {
+    for (auto &word : words) {
+        word.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LiveMeasurement::publish(const Measurement &measurement) {
+    uint64_t buffer[WORDS] = {};
+    memcpy(buffer, &measurement, sizeof(Measurement));
+    const uint64_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    // The odd sequence must be visible before any word changes
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool LiveMeasurement::read(Measurement &measurement) const {
+    uint64_t buffer[WORDS];
+    while (true) {
+        const uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if (before & 1) {
+            // A publish takes a few microseconds, once per frame
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < WORDS; i++) {
+            buffer[i] = words[i].load(std::memory_order_relaxed);
+        }
+        // The words must be read before the sequence is checked again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+    memcpy(&measurement, buffer, sizeof(Measurement));
+    return true;
+}
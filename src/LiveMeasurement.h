@@ -0,0 +1,65 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_LIVEMEASUREMENT_H
+#define THERMALCAM_LIVEMEASUREMENT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "constants.h"
+
+// State of the camera after one frame, as seen by threads other than the camera loop.
+struct Measurement {
+    uint64_t frame_no;
+    // Wall clock time (ms since the epoch) of the frame
+    int64_t time_ms;
+    // Estimated environment temperature
+    float ambient_temp;
+    // Smoothed mean skin temperature (without the calibration offset), -1 when nobody is measured
+    float mean_temp_lpf;
+    bool is_measuring;
+    // Calibrated sensor temperatures, in sensor order
+    float temperatures[SENSOR_W * SENSOR_H];
+};
+
+// Latest measurement, published by the camera loop once per frame and copied by any number of readers without
+// locks (a seqlock). The writer never waits for readers; a reader that overlaps a publish retries its copy, so
+// it never sees a torn measurement.
+class LiveMeasurement {
+
+public:
+    LiveMeasurement();
+
+    // Camera thread only.
+    void publish(const Measurement &measurement);
+
+    // Copy the latest measurement. Returns false if nothing was published yet.
+    bool read(Measurement &measurement) const;
+
+private:
+    static_assert(std::is_trivially_copyable<Measurement>::value, "Measurement is copied word by word");
+    static const size_t WORDS = (sizeof(Measurement) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // Odd while a publish is in progress, 0 before the first one
+    std::atomic<uint64_t> sequence;
+    // The payload is stored in relaxed atomics, so concurrent copies are not a data race.
+    std::atomic<uint64_t> words[WORDS];
+};
+
+
+#endif //THERMALCAM_LIVEMEASUREMENT_H
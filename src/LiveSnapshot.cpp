@@ -0,0 +1,60 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <iomanip>
+#include <sstream>
+#include "LiveSnapshot.h"
+#include "AlertImage.h"
+#include "Metrics.h"
+#include "Rasterizer.h"
+
+LiveSnapshot::LiveSnapshot(const LiveMeasurement &_live, float _colormap_min, float _colormap_max)
+        : live(_live), colormap_min(_colormap_min), colormap_max(_colormap_max), cached_frame(0) {
+}
+
+std::shared_ptr<const std::string> LiveSnapshot::jpeg(Measurement &measurement) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!live.read(measurement)) {
+        return nullptr;
+    }
+    if (cached && measurement.frame_no == cached_frame) {
+        Metrics::instance().add("live_snapshot_cache_hits_total");
+        return cached;
+    }
+    uint32_t pixels[SENSOR_W * SENSOR_H];
+    colorize_temperatures(measurement.temperatures, colormap_min, colormap_max, pixels);
+    Rasterizer raster(SENSOR_W * SCALE, SENSOR_H * SCALE);
+    raster.blit_scaled(pixels, SENSOR_W, SENSOR_H, 0, 0, raster.get_width(), raster.get_height());
+    if (measurement.is_measuring) {
+        // Same calibration offset as the display
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << measurement.mean_temp_lpf + 5.6 << "\xB0" << "C";
+        const int scale = 4;
+        const int margin = 8;
+        const int width = Rasterizer::text_width(ss.str(), scale);
+        raster.fill_rect(0, 0, width + 2 * margin, Rasterizer::text_height(scale) + 2 * margin,
+                         Rasterizer::rgb(0, 0, 0));
+        raster.draw_text(ss.str(), margin, margin, scale, Rasterizer::rgb(255, 255, 255));
+    }
+    std::shared_ptr<std::string> image = std::make_shared<std::string>();
+    if (!encode_jpeg(raster, QUALITY, *image)) {
+        return nullptr;
+    }
+    Metrics::instance().add("live_snapshot_encodes_total");
+    cached_frame = measurement.frame_no;
+    cached = image;
+    return cached;
+}
@@ -0,0 +1,53 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_LIVESNAPSHOT_H
+#define THERMALCAM_LIVESNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "LiveMeasurement.h"
+
+// JPEG of the latest thermal frame for the bot, drawn from the published temperatures (not read back from the
+// display) on the calling bot worker. Encoded at most once per frame: concurrent requests for the same frame
+// share the image.
+class LiveSnapshot {
+
+public:
+    LiveSnapshot(const LiveMeasurement &live, float colormap_min, float colormap_max);
+
+    // Image of the latest frame, and the measurement it shows. Null if no frame was published yet.
+    std::shared_ptr<const std::string> jpeg(Measurement &measurement);
+
+private:
+    // Sensor pixel size in the image: 24x32 pixels become 360x480
+    static const int SCALE = 15;
+    static const int QUALITY = 85;
+
+    const LiveMeasurement &live;
+    const float colormap_min;
+    const float colormap_max;
+
+    // Held while encoding, so callers for the frame being encoded wait for it instead of encoding it again.
+    std::mutex mutex;
+    uint64_t cached_frame;
+    std::shared_ptr<const std::string> cached;
+};
+
+
+#endif //THERMALCAM_LIVESNAPSHOT_H
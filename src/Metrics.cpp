@@ -0,0 +1,75 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include <sstream>
+#include "Metrics.h"
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics() {
+    export_time = std::chrono::steady_clock::now();
+}
+
+void Metrics::set(const std::string &name, double value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    values[name] = value;
+}
+
+void Metrics::add(const std::string &name, double delta) {
+    std::lock_guard<std::mutex> lock(mutex);
+    values[name] += delta;
+}
+
+double Metrics::get(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = values.find(name);
+    return it == values.end() ? 0.0 : it->second;
+}
+
+std::string Metrics::text() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::stringstream ss;
+    for (const auto &entry : values) {
+        ss << "thermalcam_" << entry.first << " " << entry.second << "\n";
+    }
+    return ss.str();
+}
+
+void Metrics::export_if_due() {
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (now - export_time < EXPORT_INTERVAL) {
+            return;
+        }
+        export_time = now;
+    }
+    // Write to a temporary file and rename, so the collector never reads a partial file.
+    const std::string content = text();
+    const std::string tmp_path = EXPORT_PATH + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "w");
+    if (file == nullptr) {
+        return;
+    }
+    const bool ok = fwrite(content.data(), 1, content.size(), file) == content.size();
+    if (fclose(file) == 0 && ok) {
+        rename(tmp_path.c_str(), EXPORT_PATH.c_str());
+    }
+}
@@ -0,0 +1,55 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_METRICS_H
+#define THERMALCAM_METRICS_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Process wide counters and gauges, exported as a Prometheus text file (node_exporter textfile collector).
+class Metrics {
+
+public:
+    static Metrics &instance();
+
+    void set(const std::string &name, double value);
+
+    void add(const std::string &name, double delta = 1.0);
+
+    double get(const std::string &name);
+
+    // Prometheus text exposition of all metrics.
+    std::string text();
+
+    // Rewrite the export file if the export interval elapsed. Cheap to call every frame.
+    void export_if_due();
+
+private:
+    const std::string EXPORT_PATH = "/tmp/thermalcam.prom";
+    const std::chrono::seconds EXPORT_INTERVAL = std::chrono::seconds(15);
+
+    std::mutex mutex;
+    std::map<std::string, double> values;
+    std::chrono::steady_clock::time_point export_time;
+
+    Metrics();
+};
+
+
+#endif //THERMALCAM_METRICS_H
@@ -0,0 +1,133 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "QuantileSketch.h"
+
+QuantileSketch::QuantileSketch(uint16_t _k) : k(_k), random_state(0x9E3779B9u) {
+    clear();
+}
+
+void QuantileSketch::clear() {
+    n = 0;
+    min_value = NAN;
+    max_value = NAN;
+    levels.assign(1, std::vector<float>());
+}
+
+size_t QuantileSketch::capacity(size_t level) const {
+    // The top level holds k items, each level below 2/3 of the one above it
+    const size_t depth = levels.size() - 1 - level;
+    return std::max(MIN_CAPACITY, static_cast<size_t>(std::ceil(k * std::pow(CAPACITY_RATIO, depth))));
+}
+
+size_t QuantileSketch::retained() const {
+    size_t items = 0;
+    for (const std::vector<float> &level : levels) {
+        items += level.size();
+    }
+    return items;
+}
+
+void QuantileSketch::add(float value) {
+    if (std::isnan(value)) {
+        return;
+    }
+    min_value = n == 0 ? value : std::min(min_value, value);
+    max_value = n == 0 ? value : std::max(max_value, value);
+    n++;
+    levels[0].push_back(value);
+    if (levels[0].size() >= capacity(0)) {
+        compress();
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+    if (other.n == 0) {
+        return;
+    }
+    min_value = n == 0 ? other.min_value : std::min(min_value, other.min_value);
+    max_value = n == 0 ? other.max_value : std::max(max_value, other.max_value);
+    n += other.n;
+    if (levels.size() < other.levels.size()) {
+        levels.resize(other.levels.size());
+    }
+    for (size_t h = 0; h < other.levels.size(); h++) {
+        levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+    }
+    compress();
+}
+
+void QuantileSketch::compress() {
+    // Capacities shrink when a level is added, so go up from the bottom until every level fits
+    for (size_t h = 0; h < levels.size(); h++) {
+        if (levels[h].size() >= capacity(h)) {
+            compact(h);
+        }
+    }
+}
+
+void QuantileSketch::compact(size_t level) {
+    if (level + 1 == levels.size()) {
+        levels.emplace_back();
+    }
+    std::vector<float> &items = levels[level];
+    std::sort(items.begin(), items.end());
+    // With an odd count the smallest item stays, the others are paired
+    const size_t first = items.size() % 2;
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    const size_t offset = random_state & 1;
+    std::vector<float> &next = levels[level + 1];
+    for (size_t i = first + offset; i < items.size(); i += 2) {
+        next.push_back(items[i]);
+    }
+    items.resize(first);
+}
+
+float QuantileSketch::quantile(double fraction) const {
+    if (n == 0) {
+        return NAN;
+    }
+    if (fraction <= 0) {
+        return min_value;
+    }
+    if (fraction >= 1) {
+        return max_value;
+    }
+    std::vector<std::pair<float, uint64_t>> weighted;
+    weighted.reserve(retained());
+    uint64_t total = 0;
+    for (size_t h = 0; h < levels.size(); h++) {
+        for (float value : levels[h]) {
+            weighted.emplace_back(value, uint64_t(1) << h);
+            total += uint64_t(1) << h;
+        }
+    }
+    std::sort(weighted.begin(), weighted.end());
+    const double target = fraction * static_cast<double>(total);
+    uint64_t seen = 0;
+    for (const auto &item : weighted) {
+        seen += item.second;
+        if (static_cast<double>(seen) >= target) {
+            return item.first;
+        }
+    }
+    return max_value;
+}
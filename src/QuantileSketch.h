@@ -0,0 +1,69 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_QUANTILESKETCH_H
+#define THERMALCAM_QUANTILESKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// KLL streaming quantile sketch (Karnin, Lang, Liberty 2016). Keeps a stack of compactors: level h holds items
+// of weight 2^h, and a full level is sorted and every other item is promoted to the next one. The size grows
+// with log(n) only, and two sketches merge into one with the same error (about 1.7/k in rank for k = 200).
+class QuantileSketch {
+
+public:
+    static const uint16_t DEFAULT_K = 200;
+
+    explicit QuantileSketch(uint16_t k = DEFAULT_K);
+
+    void add(float value);
+
+    void merge(const QuantileSketch &other);
+
+    // Value at the given rank fraction (0.5 for the median), NAN if empty.
+    float quantile(double fraction) const;
+
+    uint64_t count() const { return n; }
+
+    // Items kept, for the memory bound.
+    size_t retained() const;
+
+    void clear();
+
+private:
+    // Smallest level capacity, and the capacity ratio between consecutive levels
+    static const size_t MIN_CAPACITY = 8;
+    static constexpr double CAPACITY_RATIO = 2.0 / 3.0;
+
+    uint16_t k;
+    uint64_t n;
+    float min_value;
+    float max_value;
+    std::vector<std::vector<float>> levels;
+    // Picks which half of a compacted level is kept
+    uint32_t random_state;
+
+    size_t capacity(size_t level) const;
+
+    void compress();
+
+    void compact(size_t level);
+};
+
+
+#endif //THERMALCAM_QUANTILESKETCH_H
@@ -0,0 +1,268 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstdio>
+#include "Rasterizer.h"
+
+// 5x7 bitmap font, one byte per row, bit 4 is the leftmost column.
+static const uint8_t FONT_DIGITS[10][7] = {
+        {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},
+        {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+        {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+        {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+        {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+        {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+        {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+        {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+        {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+        {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+};
+
+static const uint8_t FONT_LETTERS[26][7] = {
+        {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+        {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E},
+        {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E},
+        {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+        {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},
+        {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10},
+        {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F},
+        {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+        {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E},
+        {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C},
+        {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11},
+        {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F},
+        {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11},
+        {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11},
+        {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+        {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+        {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D},
+        {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11},
+        {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},
+        {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04},
+        {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E},
+        {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04},
+        {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A},
+        {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11},
+        {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04},
+        {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F},
+};
+
+static const char FONT_SYMBOL_CHARS[] = ".:-+()/!\xB0";
+static const uint8_t FONT_SYMBOLS[][7] = {
+        {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C},
+        {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00},
+        {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00},
+        {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00},
+        {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02},
+        {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08},
+        {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00},
+        {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04},
+        {0x0C, 0x12, 0x12, 0x0C, 0x00, 0x00, 0x00},
+};
+
+static const int GLYPH_W = 5;
+static const int GLYPH_H = 7;
+static const int GLYPH_ADVANCE = 6;
+
+Rasterizer::Rasterizer(int _width, int _height) : width(_width), height(_height),
+                                                  buffer(static_cast<size_t>(_width) * _height, 0) {
+}
+
+void Rasterizer::clear(uint32_t color) {
+    std::fill(buffer.begin(), buffer.end(), color);
+}
+
+void Rasterizer::fill_rect(int x, int y, int w, int h, uint32_t color) {
+    const int x0 = std::max(0, x);
+    const int y0 = std::max(0, y);
+    const int x1 = std::min(width, x + w);
+    const int y1 = std::min(height, y + h);
+    for (int j = y0; j < y1; j++) {
+        std::fill(buffer.begin() + j * width + x0, buffer.begin() + j * width + std::max(x0, x1), color);
+    }
+}
+
+void Rasterizer::blit_scaled(const uint32_t *src, int src_w, int src_h, int x, int y, int w, int h) {
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    for (int j = std::max(0, y); j < std::min(height, y + h); j++) {
+        const int sy = (j - y) * src_h / h;
+        for (int i = std::max(0, x); i < std::min(width, x + w); i++) {
+            const int sx = (i - x) * src_w / w;
+            buffer[j * width + i] = src[sy * src_w + sx];
+        }
+    }
+}
+
+const uint8_t *Rasterizer::glyph(char c) {
+    if (c >= '0' && c <= '9') {
+        return FONT_DIGITS[c - '0'];
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return FONT_LETTERS[c - 'A'];
+    }
+    if (c >= 'a' && c <= 'z') {
+        return FONT_LETTERS[c - 'a'];
+    }
+    for (size_t i = 0; FONT_SYMBOL_CHARS[i] != '\0'; i++) {
+        if (FONT_SYMBOL_CHARS[i] == c) {
+            return FONT_SYMBOLS[i];
+        }
+    }
+    return nullptr;
+}
+
+void Rasterizer::draw_text(const std::string &text, int x, int y, int scale, uint32_t color) {
+    for (char c : text) {
+        const uint8_t *rows = glyph(c);
+        if (rows != nullptr) {
+            for (int row = 0; row < GLYPH_H; row++) {
+                for (int col = 0; col < GLYPH_W; col++) {
+                    if (rows[row] & (0x10u >> col)) {
+                        fill_rect(x + col * scale, y + row * scale, scale, scale, color);
+                    }
+                }
+            }
+        }
+        if (c != '\n') {
+            x += GLYPH_ADVANCE * scale;
+        }
+    }
+}
+
+int Rasterizer::text_width(const std::string &text, int scale) {
+    int n = 0;
+    for (char c : text) {
+        n += c != '\n' ? 1 : 0;
+    }
+    return n * GLYPH_ADVANCE * scale;
+}
+
+int Rasterizer::text_height(int scale) {
+    return GLYPH_H * scale;
+}
+
+Rasterizer Rasterizer::downscaled(int w, int h) const {
+    Rasterizer result(std::max(1, w), std::max(1, h));
+    for (int j = 0; j < result.height; j++) {
+        const int y0 = j * height / result.height;
+        const int y1 = std::max(y0 + 1, (j + 1) * height / result.height);
+        for (int i = 0; i < result.width; i++) {
+            const int x0 = i * width / result.width;
+            const int x1 = std::max(x0 + 1, (i + 1) * width / result.width);
+            uint32_t r = 0, g = 0, b = 0;
+            for (int y = y0; y < y1; y++) {
+                for (int x = x0; x < x1; x++) {
+                    const uint32_t p = buffer[y * width + x];
+                    r += p & 0xFFu;
+                    g += (p >> 8u) & 0xFFu;
+                    b += (p >> 16u) & 0xFFu;
+                }
+            }
+            const uint32_t n = static_cast<uint32_t>((y1 - y0) * (x1 - x0));
+            result.buffer[j * result.width + i] = rgb(r / n, g / n, b / n);
+        }
+    }
+    return result;
+}
+
+bool Rasterizer::save_bmp(const std::string &path) const {
+    // 24-bit uncompressed BMP, rows stored bottom-up and padded to 4 bytes.
+    const uint32_t row_size = (static_cast<uint32_t>(width) * 3 + 3) & ~3u;
+    const uint32_t data_size = row_size * height;
+    const uint32_t file_size = 54 + data_size;
+    uint8_t header[54] = {'B', 'M'};
+    auto put32 = [&header](int offset, uint32_t v) {
+        header[offset] = v & 0xFFu;
+        header[offset + 1] = (v >> 8u) & 0xFFu;
+        header[offset + 2] = (v >> 16u) & 0xFFu;
+        header[offset + 3] = (v >> 24u) & 0xFFu;
+    };
+    put32(2, file_size);
+    put32(10, 54);
+    put32(14, 40);
+    put32(18, width);
+    put32(22, height);
+    header[26] = 1;
+    header[28] = 24;
+    put32(34, data_size);
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    std::vector<uint8_t> row(row_size, 0);
+    for (int y = height - 1; y >= 0 && ok; y--) {
+        for (int x = 0; x < width; x++) {
+            const uint32_t p = buffer[y * width + x];
+            row[x * 3] = (p >> 16u) & 0xFFu;
+            row[x * 3 + 1] = (p >> 8u) & 0xFFu;
+            row[x * 3 + 2] = p & 0xFFu;
+        }
+        ok = fwrite(row.data(), 1, row_size, file) == row_size;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+bool Rasterizer::load_bmp(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t header[54];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || header[0] != 'B' || header[1] != 'M') {
+        fclose(file);
+        return false;
+    }
+    auto get32 = [&header](int offset) {
+        return static_cast<uint32_t>(header[offset]) | static_cast<uint32_t>(header[offset + 1]) << 8u |
+               static_cast<uint32_t>(header[offset + 2]) << 16u | static_cast<uint32_t>(header[offset + 3]) << 24u;
+    };
+    const uint32_t data_offset = get32(10);
+    const auto w = static_cast<int32_t>(get32(18));
+    const auto h = static_cast<int32_t>(get32(22));
+    const int bytes_per_pixel = header[28] / 8;
+    const uint32_t compression = get32(30);
+    // 32 bit images from SDL use BI_BITFIELDS with the default BGRA layout.
+    if (w <= 0 || h == 0 || (bytes_per_pixel != 3 && bytes_per_pixel != 4) || (compression != 0 && compression != 3) ||
+        fseek(file, data_offset, SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+    const int rows = h < 0 ? -h : h;
+    const size_t row_size = (static_cast<size_t>(w) * bytes_per_pixel + 3) & ~static_cast<size_t>(3);
+    std::vector<uint32_t> pixels(static_cast<size_t>(w) * rows);
+    std::vector<uint8_t> row(row_size);
+    bool ok = true;
+    for (int i = 0; i < rows && ok; i++) {
+        ok = fread(row.data(), 1, row_size, file) == row_size;
+        // Rows are stored bottom-up unless the height is negative.
+        const int y = h > 0 ? rows - 1 - i : i;
+        for (int x = 0; x < w && ok; x++) {
+            const uint8_t *p = row.data() + x * bytes_per_pixel;
+            pixels[static_cast<size_t>(y) * w + x] = rgb(p[2], p[1], p[0]);
+        }
+    }
+    fclose(file);
+    if (ok) {
+        width = w;
+        height = rows;
+        buffer.swap(pixels);
+    }
+    return ok;
+}
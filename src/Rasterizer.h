@@ -0,0 +1,72 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_RASTERIZER_H
+#define THERMALCAM_RASTERIZER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal software rasterizer used to draw alert images without SDL (headless mode).
+// Colors use the same packing as ThermalCamera::pixels: 0x00BBGGRR.
+class Rasterizer {
+
+public:
+    Rasterizer(int width, int height);
+
+    int get_width() const { return width; }
+
+    int get_height() const { return height; }
+
+    const std::vector<uint32_t> &data() const { return buffer; }
+
+    void clear(uint32_t color);
+
+    void fill_rect(int x, int y, int w, int h, uint32_t color);
+
+    // Nearest neighbour scaling of a src_w x src_h image into the given rectangle.
+    void blit_scaled(const uint32_t *src, int src_w, int src_h, int x, int y, int w, int h);
+
+    // Draw text with the built-in 5x7 font, each font pixel being scale x scale pixels.
+    void draw_text(const std::string &text, int x, int y, int scale, uint32_t color);
+
+    static int text_width(const std::string &text, int scale);
+
+    static int text_height(int scale);
+
+    // Box filtered copy at a smaller size, for previews and thumbnails.
+    Rasterizer downscaled(int width, int height) const;
+
+    bool save_bmp(const std::string &path) const;
+
+    // Replace the contents with an uncompressed 24 or 32 bit BMP (as written by save_bmp() or SDL_SaveBMP()).
+    bool load_bmp(const std::string &path);
+
+    static uint32_t rgb(uint8_t r, uint8_t g, uint8_t b) {
+        return (uint32_t) b << 16u | (uint32_t) g << 8u | r;
+    }
+
+private:
+    int width;
+    int height;
+    std::vector<uint32_t> buffer;
+
+    static const uint8_t *glyph(char c);
+};
+
+
+#endif //THERMALCAM_RASTERIZER_H
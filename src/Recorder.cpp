@@ -0,0 +1,213 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include "Recorder.h"
+#include "Metrics.h"
+
+Recorder::Recorder(const std::string &_folder, const uint16_t *_eeprom, int _fps, float _emissivity,
+                   uint64_t _max_bytes) : folder(_folder), fps(_fps), emissivity(_emissivity), max_bytes(_max_bytes),
+                                          queue(QUEUE_SIZE), queue_head(0), queue_count(0), stopping(false), fd(-1),
+                                          file_start_ms(0), file_offset(0), raw_total(0), stored_total(0) {
+    memcpy(eeprom, _eeprom, sizeof(eeprom));
+    block_frames.reserve(recording::KEYFRAME_INTERVAL);
+    thread = std::thread(&Recorder::run, this);
+}
+
+Recorder::~Recorder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+bool Recorder::record(const uint16_t *words, uint64_t frame_no, int64_t time_ms) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue_count == queue.size()) {
+            Metrics::instance().add("recording_frames_dropped_total");
+            return false;
+        }
+        RecordedFrame &slot = queue[(queue_head + queue_count) % queue.size()];
+        slot.frame_no = frame_no;
+        slot.time_ms = time_ms;
+        memcpy(slot.words, words, sizeof(slot.words));
+        queue_count++;
+    }
+    cv.notify_one();
+    return true;
+}
+
+void Recorder::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || queue_count > 0; });
+            if (queue_count == 0) {
+                // Stopping: flush what is left
+                break;
+            }
+            // Move the queued frames into the block being built, the queue lock is held only for the copy
+            while (queue_count > 0 && block_frames.size() < recording::KEYFRAME_INTERVAL) {
+                block_frames.push_back(queue[queue_head]);
+                queue_head = (queue_head + 1) % queue.size();
+                queue_count--;
+            }
+        }
+        if (block_frames.size() == recording::KEYFRAME_INTERVAL) {
+            write_block();
+        }
+    }
+    write_block();
+    close_file();
+}
+
+void Recorder::write_block() {
+    if (block_frames.empty()) {
+        return;
+    }
+    const int64_t first_ms = block_frames.front().time_ms;
+    if (fd >= 0 && first_ms - file_start_ms >= std::chrono::duration_cast<std::chrono::milliseconds>(
+            FILE_DURATION).count()) {
+        close_file();
+    }
+    if (fd < 0 && !open_file(first_ms)) {
+        Metrics::instance().add("recording_frames_dropped_total", static_cast<double>(block_frames.size()));
+        block_frames.clear();
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    size_t raw_size = 0;
+    if (!recording::encode_block(block_frames, block, scratch, raw_size)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Recording: unable to encode block");
+        block_frames.clear();
+        return;
+    }
+    const auto encoded = std::chrono::steady_clock::now();
+    if (write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Recording: write to %s failed", file_path.c_str());
+        // Drop the partial block from the file, the index only lists complete ones
+        if (ftruncate(fd, static_cast<off_t>(file_offset)) != 0 ||
+            lseek(fd, static_cast<off_t>(file_offset), SEEK_SET) < 0) {
+            close_file();
+        }
+        block_frames.clear();
+        return;
+    }
+    const auto written = std::chrono::steady_clock::now();
+    file_index.push_back({block_frames.front().frame_no, first_ms, file_offset,
+                          static_cast<uint32_t>(block_frames.size())});
+    file_offset += block.size();
+    raw_total += raw_size;
+    stored_total += block.size();
+    const double encode_ms = std::chrono::duration<double, std::milli>(encoded - start).count();
+    const double write_ms = std::chrono::duration<double, std::milli>(written - encoded).count();
+    Metrics::instance().add("recording_frames_total", static_cast<double>(block_frames.size()));
+    Metrics::instance().add("recording_bytes_total", static_cast<double>(block.size()));
+    Metrics::instance().set("recording_compression_ratio", static_cast<double>(raw_total) / stored_total);
+    Metrics::instance().set("recording_block_encode_ms", encode_ms);
+    Metrics::instance().set("recording_block_write_ms", write_ms);
+    block_frames.clear();
+}
+
+bool Recorder::open_file(int64_t time_ms) {
+    const std::time_t time = static_cast<std::time_t>(time_ms / 1000);
+    std::tm local = {};
+    localtime_r(&time, &local);
+    char day[16], name[32];
+    strftime(day, sizeof(day), "%Y/%m/%d", &local);
+    strftime(name, sizeof(name), "%Y%m%d_%H%M%S.tcr", &local);
+    const std::filesystem::path day_folder = std::filesystem::path(folder) / day;
+    std::error_code error;
+    std::filesystem::create_directories(day_folder, error);
+    file_path = (day_folder / name).string();
+    fd = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Recording: unable to create %s", file_path.c_str());
+        return false;
+    }
+    const std::string header = recording::encode_header(eeprom, fps, emissivity, time_ms);
+    if (write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Recording: write to %s failed", file_path.c_str());
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    file_start_ms = time_ms;
+    file_offset = header.size();
+    file_index.clear();
+    return true;
+}
+
+void Recorder::close_file() {
+    if (fd < 0) {
+        return;
+    }
+    const std::string index = recording::encode_index(file_index, file_offset);
+    if (write(fd, index.data(), index.size()) != static_cast<ssize_t>(index.size())) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Recording: no index in %s", file_path.c_str());
+    }
+    fdatasync(fd);
+    close(fd);
+    fd = -1;
+    uint32_t frames = 0;
+    for (const RecordingBlockInfo &info : file_index) {
+        frames += info.frames;
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recording: %s closed, %u frames, %.1f MB, compression %.2f:1",
+                file_path.c_str(), frames, file_offset / 1e6,
+                stored_total > 0 ? static_cast<double>(raw_total) / stored_total : 0.0);
+    enforce_budget();
+}
+
+void Recorder::enforce_budget() {
+    std::vector<std::filesystem::path> files;
+    uint64_t total = 0;
+    std::error_code error;
+    for (auto it = std::filesystem::recursive_directory_iterator(folder, error);
+         it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+        if (it->is_regular_file() && it->path().extension() == ".tcr") {
+            files.push_back(it->path());
+            total += it->file_size();
+        }
+    }
+    // The names sort by time
+    std::sort(files.begin(), files.end(), [](const std::filesystem::path &a, const std::filesystem::path &b) {
+        return a.filename() < b.filename();
+    });
+    size_t deleted = 0;
+    for (size_t i = 0; total > max_bytes && i + 1 < files.size(); i++) {
+        const uint64_t size = std::filesystem::file_size(files[i], error);
+        if (std::filesystem::remove(files[i], error)) {
+            total -= error ? 0 : size;
+            deleted++;
+            // Remove the day folder once it is empty
+            std::filesystem::remove(files[i].parent_path(), error);
+        }
+    }
+    if (deleted > 0) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recording: deleted %zu old files", deleted);
+    }
+    Metrics::instance().set("recording_store_bytes", static_cast<double>(total));
+}
@@ -0,0 +1,86 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_RECORDER_H
+#define THERMALCAM_RECORDER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Recording.h"
+
+// Continuous recording of the raw sensor frames (see Recording.h). The camera loop copies each frame into a
+// preallocated queue; a background thread encodes blocks of KEYFRAME_INTERVAL frames and writes each one with a
+// single write(). A new file is started every hour, and the oldest files are deleted beyond max_bytes.
+class Recorder {
+
+public:
+    Recorder(const std::string &folder, const uint16_t *eeprom, int fps, float emissivity, uint64_t max_bytes);
+
+    virtual ~Recorder();
+
+    // Queue a frame without blocking on the disk. Returns false (and drops the frame) if the writer is behind.
+    bool record(const uint16_t *words, uint64_t frame_no, int64_t time_ms);
+
+private:
+    // Frames the writer may fall behind by, four blocks
+    static const size_t QUEUE_SIZE = 4 * recording::KEYFRAME_INTERVAL;
+    const std::chrono::hours FILE_DURATION = std::chrono::hours(1);
+
+    const std::string folder;
+    uint16_t eeprom[RECORDING_EEPROM_WORDS];
+    const int fps;
+    const float emissivity;
+    const uint64_t max_bytes;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Ring of queued frames
+    std::vector<RecordedFrame> queue;
+    size_t queue_head;
+    size_t queue_count;
+    bool stopping;
+    std::thread thread;
+
+    // Writer thread state
+    int fd;
+    std::string file_path;
+    int64_t file_start_ms;
+    uint64_t file_offset;
+    std::vector<RecordingBlockInfo> file_index;
+    std::vector<RecordedFrame> block_frames;
+    std::string block;
+    std::vector<uint8_t> scratch;
+    uint64_t raw_total;
+    uint64_t stored_total;
+
+    void run();
+
+    void write_block();
+
+    bool open_file(int64_t time_ms);
+
+    void close_file();
+
+    void enforce_budget();
+};
+
+
+#endif //THERMALCAM_RECORDER_H
@@ -0,0 +1,325 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#include "Recording.h"
+
+namespace recording {
+
+static void put_varint(std::vector<uint8_t> &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// CRC of the block header fields after the magic and of the payload
+static uint32_t block_crc(const uint8_t *header, const Bytef *payload, uLong payload_size) {
+    const uLong crc = crc32(0L, header + 4, 28);
+    return static_cast<uint32_t>(crc32(crc, payload, payload_size));
+}
+
+std::string encode_header(const uint16_t *eeprom, int fps, float emissivity, int64_t created_ms) {
+    std::string header(HEADER_SIZE, '\0');
+    const uint16_t fps_value = static_cast<uint16_t>(fps);
+    memcpy(&header[0], &FILE_MAGIC, 4);
+    memcpy(&header[4], &VERSION, 2);
+    memcpy(&header[6], &fps_value, 2);
+    memcpy(&header[8], &created_ms, 8);
+    memcpy(&header[16], &emissivity, 4);
+    memcpy(&header[24], eeprom, RECORDING_EEPROM_WORDS * 2);
+    return header;
+}
+
+bool encode_block(const std::vector<RecordedFrame> &frames, std::string &block, std::vector<uint8_t> &scratch,
+                  size_t &raw_size) {
+    if (frames.empty()) {
+        return false;
+    }
+    scratch.clear();
+    const RecordedFrame *previous = nullptr;
+    for (const RecordedFrame &frame : frames) {
+        put_varint(scratch, previous ? frame.frame_no - previous->frame_no : 0);
+        put_varint(scratch, zigzag(previous ? frame.time_ms - previous->time_ms : 0));
+        for (size_t i = 0; i < RECORDING_FRAME_WORDS; i++) {
+            // 16 bit difference, wraps around; the keyframe is the difference to zero
+            const auto delta = static_cast<int16_t>(frame.words[i] - (previous ? previous->words[i] : 0));
+            put_varint(scratch, zigzag(delta));
+        }
+        previous = &frame;
+    }
+    uLongf compressed_size = compressBound(scratch.size());
+    block.resize(BLOCK_HEADER_SIZE + compressed_size);
+    auto *payload = reinterpret_cast<Bytef *>(&block[BLOCK_HEADER_SIZE]);
+    if (compress2(payload, &compressed_size, scratch.data(), scratch.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    block.resize(BLOCK_HEADER_SIZE + compressed_size);
+    const auto count = static_cast<uint32_t>(frames.size());
+    const auto varint_size = static_cast<uint32_t>(scratch.size());
+    const auto payload_size = static_cast<uint32_t>(compressed_size);
+    memcpy(&block[0], &BLOCK_MAGIC, 4);
+    memcpy(&block[4], &count, 4);
+    memcpy(&block[8], &frames.front().frame_no, 8);
+    memcpy(&block[16], &frames.front().time_ms, 8);
+    memcpy(&block[24], &varint_size, 4);
+    memcpy(&block[28], &payload_size, 4);
+    const uint32_t crc = block_crc(reinterpret_cast<const uint8_t *>(block.data()), payload, compressed_size);
+    memcpy(&block[32], &crc, 4);
+    raw_size = frames.size() * RECORDING_FRAME_WORDS * 2;
+    return true;
+}
+
+std::string encode_index(const std::vector<RecordingBlockInfo> &index, uint64_t index_offset) {
+    std::string data(index.size() * INDEX_ENTRY_SIZE + INDEX_TRAILER_SIZE, '\0');
+    for (size_t i = 0; i < index.size(); i++) {
+        char *entry = &data[i * INDEX_ENTRY_SIZE];
+        memcpy(entry, &index[i].first_frame_no, 8);
+        memcpy(entry + 8, &index[i].first_time_ms, 8);
+        memcpy(entry + 16, &index[i].offset, 8);
+        memcpy(entry + 24, &index[i].frames, 4);
+    }
+    const auto count = static_cast<uint32_t>(index.size());
+    char *trailer = &data[index.size() * INDEX_ENTRY_SIZE];
+    memcpy(trailer, &index_offset, 8);
+    memcpy(trailer + 8, &count, 4);
+    memcpy(trailer + 12, &INDEX_MAGIC, 4);
+    return data;
+}
+
+static bool decode_block(const std::string &block, std::vector<RecordedFrame> &frames) {
+    uint32_t count, varint_size, payload_size, crc;
+    uint64_t frame_no;
+    int64_t time_ms;
+    memcpy(&count, &block[4], 4);
+    memcpy(&frame_no, &block[8], 8);
+    memcpy(&time_ms, &block[16], 8);
+    memcpy(&varint_size, &block[24], 4);
+    memcpy(&payload_size, &block[28], 4);
+    memcpy(&crc, &block[32], 4);
+    const auto *payload = reinterpret_cast<const Bytef *>(block.data() + BLOCK_HEADER_SIZE);
+    if (block.size() != BLOCK_HEADER_SIZE + payload_size || count > KEYFRAME_INTERVAL ||
+        varint_size > count * MAX_FRAME_VARINT_SIZE) {
+        return false;
+    }
+    if (crc != block_crc(reinterpret_cast<const uint8_t *>(block.data()), payload, payload_size)) {
+        return false;
+    }
+    std::vector<uint8_t> varints(varint_size);
+    uLongf size = varint_size;
+    if (uncompress(varints.data(), &size, payload, payload_size) != Z_OK || size != varint_size) {
+        return false;
+    }
+    frames.resize(count);
+    const uint8_t *p = varints.data();
+    const uint8_t *end = p + size;
+    for (uint32_t f = 0; f < count; f++) {
+        RecordedFrame &frame = frames[f];
+        const RecordedFrame *previous = f > 0 ? &frames[f - 1] : nullptr;
+        uint64_t frame_delta, time_delta, value;
+        if (!get_varint(p, end, frame_delta) || !get_varint(p, end, time_delta)) {
+            return false;
+        }
+        frame.frame_no = previous ? previous->frame_no + frame_delta : frame_no;
+        frame.time_ms = previous ? previous->time_ms + unzigzag(time_delta) : time_ms;
+        for (size_t i = 0; i < RECORDING_FRAME_WORDS; i++) {
+            if (!get_varint(p, end, value)) {
+                return false;
+            }
+            frame.words[i] = static_cast<uint16_t>((previous ? previous->words[i] : 0) + unzigzag(value));
+        }
+    }
+    return true;
+}
+
+}
+
+RecordingReader::RecordingReader() : file(nullptr), frame_rate(0), emissivity_value(0), next_block(0),
+                                     next_frame(0) {
+}
+
+RecordingReader::~RecordingReader() {
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+bool RecordingReader::open(const std::string &path) {
+    file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    std::string header(recording::HEADER_SIZE, '\0');
+    uint32_t magic = 0;
+    uint16_t version = 0, fps = 0;
+    if (fread(&header[0], 1, header.size(), file) != header.size()) {
+        return false;
+    }
+    memcpy(&magic, &header[0], 4);
+    memcpy(&version, &header[4], 2);
+    memcpy(&fps, &header[6], 2);
+    memcpy(&emissivity_value, &header[16], 4);
+    memcpy(eeprom_words, &header[24], RECORDING_EEPROM_WORDS * 2);
+    if (magic != recording::FILE_MAGIC || version != recording::VERSION) {
+        return false;
+    }
+    frame_rate = fps;
+    fseeko(file, 0, SEEK_END);
+    const auto file_size = static_cast<uint64_t>(ftello(file));
+    if (!read_index(file_size)) {
+        scan_blocks(file_size);
+    }
+    next_block = 0;
+    decoded.clear();
+    next_frame = 0;
+    return true;
+}
+
+bool RecordingReader::read_index(uint64_t file_size) {
+    uint8_t trailer[recording::INDEX_TRAILER_SIZE];
+    if (file_size < recording::HEADER_SIZE + recording::INDEX_TRAILER_SIZE ||
+        fseeko(file, static_cast<off_t>(file_size - recording::INDEX_TRAILER_SIZE), SEEK_SET) != 0 ||
+        fread(trailer, 1, sizeof(trailer), file) != sizeof(trailer)) {
+        return false;
+    }
+    uint64_t index_offset;
+    uint32_t count, magic;
+    memcpy(&index_offset, trailer, 8);
+    memcpy(&count, trailer + 8, 4);
+    memcpy(&magic, trailer + 12, 4);
+    if (magic != recording::INDEX_MAGIC ||
+        index_offset + count * recording::INDEX_ENTRY_SIZE + recording::INDEX_TRAILER_SIZE != file_size) {
+        return false;
+    }
+    std::vector<uint8_t> entries(count * recording::INDEX_ENTRY_SIZE);
+    if (fseeko(file, static_cast<off_t>(index_offset), SEEK_SET) != 0 ||
+        fread(entries.data(), 1, entries.size(), file) != entries.size()) {
+        return false;
+    }
+    index.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *entry = entries.data() + i * recording::INDEX_ENTRY_SIZE;
+        memcpy(&index[i].first_frame_no, entry, 8);
+        memcpy(&index[i].first_time_ms, entry + 8, 8);
+        memcpy(&index[i].offset, entry + 16, 8);
+        memcpy(&index[i].frames, entry + 24, 4);
+    }
+    return true;
+}
+
+void RecordingReader::scan_blocks(uint64_t file_size) {
+    index.clear();
+    uint64_t offset = recording::HEADER_SIZE;
+    uint8_t header[recording::BLOCK_HEADER_SIZE];
+    while (offset + recording::BLOCK_HEADER_SIZE <= file_size &&
+           fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0 &&
+           fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        uint32_t magic, payload_size;
+        RecordingBlockInfo info;
+        memcpy(&magic, header, 4);
+        memcpy(&info.frames, header + 4, 4);
+        memcpy(&info.first_frame_no, header + 8, 8);
+        memcpy(&info.first_time_ms, header + 16, 8);
+        memcpy(&payload_size, header + 28, 4);
+        if (magic != recording::BLOCK_MAGIC || offset + recording::BLOCK_HEADER_SIZE + payload_size > file_size) {
+            // Torn last block
+            break;
+        }
+        info.offset = offset;
+        index.push_back(info);
+        offset += recording::BLOCK_HEADER_SIZE + payload_size;
+    }
+}
+
+bool RecordingReader::load_block(size_t block) {
+    uint8_t header[recording::BLOCK_HEADER_SIZE];
+    if (fseeko(file, static_cast<off_t>(index[block].offset), SEEK_SET) != 0 ||
+        fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        return false;
+    }
+    uint32_t payload_size;
+    memcpy(&payload_size, header + 28, 4);
+    if (payload_size > compressBound(recording::KEYFRAME_INTERVAL * recording::MAX_FRAME_VARINT_SIZE)) {
+        return false;
+    }
+    std::string data(recording::BLOCK_HEADER_SIZE + payload_size, '\0');
+    memcpy(&data[0], header, sizeof(header));
+    if (fread(&data[recording::BLOCK_HEADER_SIZE], 1, payload_size, file) != payload_size) {
+        return false;
+    }
+    next_frame = 0;
+    return recording::decode_block(data, decoded);
+}
+
+bool RecordingReader::seek(int64_t time_ms) {
+    // Last block starting at or before time_ms
+    auto it = std::upper_bound(index.begin(), index.end(), time_ms,
+                               [](int64_t t, const RecordingBlockInfo &info) { return t < info.first_time_ms; });
+    next_block = it == index.begin() ? 0 : static_cast<size_t>(it - index.begin()) - 1;
+    decoded.clear();
+    next_frame = 0;
+    RecordedFrame frame;
+    while (next(frame)) {
+        if (frame.time_ms >= time_ms) {
+            next_frame--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RecordingReader::seek_block(size_t block) {
+    next_block = block;
+    decoded.clear();
+    next_frame = 0;
+    return block < index.size();
+}
+
+bool RecordingReader::next(RecordedFrame &frame) {
+    while (next_frame >= decoded.size()) {
+        if (next_block >= index.size() || !load_block(next_block)) {
+            decoded.clear();
+            next_frame = 0;
+            return false;
+        }
+        next_block++;
+    }
+    frame = decoded[next_frame++];
+    return true;
+}
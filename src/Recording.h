@@ -0,0 +1,126 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_RECORDING_H
+#define THERMALCAM_RECORDING_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Raw sensor frame as read by MLX90640_GetFrameData(): 768 pixel words, 64 auxiliary words, the control
+// register and the subpage number.
+static const size_t RECORDING_FRAME_WORDS = 834;
+static const size_t RECORDING_EEPROM_WORDS = 832;
+
+struct RecordedFrame {
+    uint64_t frame_no;
+    // Wall clock time (ms since the epoch)
+    int64_t time_ms;
+    uint16_t words[RECORDING_FRAME_WORDS];
+};
+
+struct RecordingBlockInfo {
+    uint64_t first_frame_no;
+    int64_t first_time_ms;
+    uint64_t offset;
+    uint32_t frames;
+};
+
+// Continuous radiometric recording (.tcr) of the raw sensor words, so the frames can be recalibrated later with
+// the EEPROM stored in the header.
+//
+// File layout (host byte order):
+// - Header: magic "TCRF", version, fps, creation time, emissivity, then the 832 EEPROM words.
+// - Blocks of up to KEYFRAME_INTERVAL frames. Each block starts with a keyframe, so it decodes on its own: every
+//   word is stored as the difference to the same word of the previous frame (to zero for the first frame), which
+//   is zero for the half of the pixels the other subpage did not update and small noise for the rest. The
+//   differences are zigzag varints, and the block is deflated (LZ77 plus Huffman coding). A block header holds
+//   the first frame number and time, the sizes and a CRC of the rest of the block header and the payload.
+// - Index, written when the file is closed: one entry per block, its count, its offset and magic "TCRI". A file
+//   left without index (power loss) is indexed by walking the block headers.
+namespace recording {
+
+const uint32_t FILE_MAGIC = 0x46524354;  // "TCRF"
+const uint32_t BLOCK_MAGIC = 0x42524354; // "TCRB"
+const uint32_t INDEX_MAGIC = 0x49524354; // "TCRI"
+const uint16_t VERSION = 1;
+const size_t HEADER_SIZE = 24 + RECORDING_EEPROM_WORDS * 2;
+const size_t BLOCK_HEADER_SIZE = 36;
+const size_t INDEX_ENTRY_SIZE = 28;
+const size_t INDEX_TRAILER_SIZE = 16;
+const size_t KEYFRAME_INTERVAL = 64;
+// Largest encoding of a frame: two 64 bit varints and a 3 byte varint per word
+const size_t MAX_FRAME_VARINT_SIZE = 20 + RECORDING_FRAME_WORDS * 3;
+
+std::string encode_header(const uint16_t *eeprom, int fps, float emissivity, int64_t created_ms);
+
+// Encode frames into a block. The buffers are reused between calls. raw_size is the size of the frames as
+// plain words.
+bool encode_block(const std::vector<RecordedFrame> &frames, std::string &block, std::vector<uint8_t> &scratch,
+                  size_t &raw_size);
+
+std::string encode_index(const std::vector<RecordingBlockInfo> &index, uint64_t index_offset);
+
+}
+
+// Reads a recording, sequentially or from the block that contains a given time.
+class RecordingReader {
+
+public:
+    RecordingReader();
+
+    virtual ~RecordingReader();
+
+    bool open(const std::string &path);
+
+    const uint16_t *eeprom() const { return eeprom_words; }
+
+    int fps() const { return frame_rate; }
+
+    float emissivity() const { return emissivity_value; }
+
+    const std::vector<RecordingBlockInfo> &blocks() const { return index; }
+
+    // Continue from the first frame at or after time_ms (from the start of its block).
+    bool seek(int64_t time_ms);
+
+    // Continue from the first frame of the given block (an entry of blocks()).
+    bool seek_block(size_t block);
+
+    // Next frame, false at the end of the recording or on a damaged block.
+    bool next(RecordedFrame &frame);
+
+private:
+    FILE *file;
+    uint16_t eeprom_words[RECORDING_EEPROM_WORDS];
+    int frame_rate;
+    float emissivity_value;
+    std::vector<RecordingBlockInfo> index;
+    size_t next_block;
+    std::vector<RecordedFrame> decoded;
+    size_t next_frame;
+
+    bool read_index(uint64_t file_size);
+
+    void scan_blocks(uint64_t file_size);
+
+    bool load_block(size_t block);
+};
+
+
+#endif //THERMALCAM_RECORDING_H
@@ -0,0 +1,459 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include "Metrics.h"
+#include "StreamServer.h"
+
+static const char *const WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const char *const BOUNDARY = "thermalcam";
+
+static const char *const INDEX_PAGE = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Cámara térmica</title></head>
+<body style="background:#000;color:#fff;font-family:sans-serif;text-align:center">
+<img id="v" style="height:85vh"><p id="t">Conectando...</p>
+<script>
+document.getElementById("v").src = "/stream.mjpg" + location.search;
+const ws = new WebSocket("ws://" + location.host + "/ws" + location.search);
+ws.binaryType = "arraybuffer";
+ws.onmessage = e => {
+  const v = new DataView(e.data), body = v.getFloat32(20, true);
+  document.getElementById("t").textContent = "Ambiente " + v.getFloat32(16, true).toFixed(1) + " °C" +
+      (isNaN(body) ? "" : " - Corporal " + body.toFixed(1) + " °C");
+};
+ws.onclose = () => document.getElementById("t").textContent = "Desconectado";
+</script></body></html>
+)";
+
+static std::shared_ptr<const std::string> response(const std::string &status, const std::string &type,
+                                                   const std::string &body) {
+    return std::make_shared<const std::string>("HTTP/1.1 " + status + "\r\nContent-Type: " + type +
+                                               "\r\nContent-Length: " + std::to_string(body.size()) +
+                                               "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n" + body);
+}
+
+static std::string header_value(const std::string &request, const std::string &name) {
+    std::istringstream lines(request);
+    std::string line;
+    while (std::getline(lines, line)) {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos || colon != name.size() || strncasecmp(line.c_str(), name.c_str(), colon) != 0) {
+            continue;
+        }
+        const size_t start = line.find_first_not_of(' ', colon + 1);
+        const size_t end = line.find_last_not_of("\r ");
+        return start == std::string::npos ? "" : line.substr(start, end + 1 - start);
+    }
+    return "";
+}
+
+static std::string websocket_accept(const std::string &key) {
+    const std::string text = key + WEBSOCKET_GUID;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char *>(text.data()), text.size(), digest);
+    unsigned char encoded[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+    const int length = EVP_EncodeBlock(encoded, digest, SHA_DIGEST_LENGTH);
+    return std::string(reinterpret_cast<const char *>(encoded), static_cast<size_t>(length));
+}
+
+StreamServer::StreamServer(const LiveMeasurement &_live, LiveSnapshot &_snapshot, const std::string &bind_address,
+                           uint16_t port, const std::string &_token)
+        : live(_live), snapshot(_snapshot), token(_token), listen_fd(-1), event_fd(-1), epoll_fd(-1),
+          stopping(false) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, bind_address.c_str(), &address.sin_addr) != 1) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Stream server: invalid address %s", bind_address.c_str());
+        return;
+    }
+    if ((ntohl(address.sin_addr.s_addr) >> 24) != 127 && token.empty()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Stream server: not started, listening on %s needs a token",
+                     bind_address.c_str());
+        return;
+    }
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, 16) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Stream server: unable to listen on %s:%u: %s",
+                     bind_address.c_str(), port, strerror(errno));
+        return;
+    }
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.fd = event_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Stream server on %s:%u%s", bind_address.c_str(), port,
+                token.empty() ? "" : ", token required");
+    thread = std::thread(&StreamServer::run, this);
+}
+
+StreamServer::~StreamServer() {
+    stopping = true;
+    notify();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    for (const auto &entry : clients) {
+        close(entry.first);
+    }
+    for (int fd : {listen_fd, event_fd, epoll_fd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void StreamServer::notify() {
+    if (event_fd >= 0) {
+        const uint64_t one = 1;
+        ssize_t ignored = write(event_fd, &one, sizeof(one));
+        (void) ignored;
+    }
+}
+
+void StreamServer::run() {
+    epoll_event events[64];
+    while (!stopping) {
+        // Wakes up at least once a second to close the idle clients
+        const int n = epoll_wait(epoll_fd, events, 64, 1000);
+        close_idle_clients();
+        for (int i = 0; i < n && !stopping; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                accept_clients();
+            } else if (fd == event_fd) {
+                uint64_t count;
+                ssize_t ignored = read(event_fd, &count, sizeof(count));
+                (void) ignored;
+                publish_frame();
+            } else {
+                auto it = clients.find(fd);
+                if (it == clients.end()) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close_client(fd);
+                    continue;
+                }
+                if ((events[i].events & EPOLLOUT) && !flush(fd, it->second)) {
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    read_client(fd, it->second);
+                }
+            }
+        }
+    }
+}
+
+void StreamServer::accept_clients() {
+    int fd;
+    while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (clients.size() >= MAX_CLIENTS) {
+            const std::shared_ptr<const std::string> busy = response("503 Service Unavailable", "text/plain",
+                                                                     "Demasiados clientes\n");
+            ssize_t ignored = send(fd, busy->data(), busy->size(), MSG_NOSIGNAL);
+            (void) ignored;
+            close(fd);
+            continue;
+        }
+        // Frames go out as soon as they are queued
+        const int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        clients[fd] = Client();
+        clients[fd].accepted = std::chrono::steady_clock::now();
+    }
+    Metrics::instance().set("stream_clients", static_cast<double>(clients.size()));
+}
+
+void StreamServer::close_idle_clients() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = clients.begin(); it != clients.end();) {
+        const int fd = it->first;
+        const bool idle = it->second.kind == CLIENT_REQUEST && now - it->second.accepted > REQUEST_TIMEOUT;
+        ++it;
+        if (idle) {
+            Metrics::instance().add("stream_clients_timed_out_total");
+            close_client(fd);
+        }
+    }
+}
+
+bool StreamServer::authorized(const std::string &query) const {
+    if (token.empty()) {
+        return true;
+    }
+    std::istringstream parameters(query);
+    std::string parameter;
+    while (std::getline(parameters, parameter, '&')) {
+        if (parameter.compare(0, 6, "token=") != 0 || parameter.size() - 6 != token.size()) {
+            continue;
+        }
+        // Compare every byte, the time does not tell how much of the token matched
+        unsigned char difference = 0;
+        for (size_t i = 0; i < token.size(); i++) {
+            difference |= static_cast<unsigned char>(parameter[6 + i] ^ token[i]);
+        }
+        return difference == 0;
+    }
+    return false;
+}
+
+void StreamServer::publish_frame() {
+    bool mjpeg = false;
+    bool websocket = false;
+    for (const auto &entry : clients) {
+        mjpeg = mjpeg || entry.second.kind == CLIENT_MJPEG;
+        websocket = websocket || entry.second.kind == CLIENT_WEBSOCKET;
+    }
+    if (!mjpeg && !websocket) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    Measurement measurement;
+    std::shared_ptr<const std::string> part;
+    if (mjpeg) {
+        // Shares the encode with /snapshot of the bot
+        std::shared_ptr<const std::string> jpeg = snapshot.jpeg(measurement);
+        if (jpeg) {
+            auto data = std::make_shared<std::string>();
+            *data = std::string("--") + BOUNDARY + "\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                    std::to_string(jpeg->size()) + "\r\n\r\n";
+            data->append(*jpeg);
+            data->append("\r\n");
+            part = data;
+        }
+    }
+    std::shared_ptr<const std::string> message;
+    if (websocket && live.read(measurement)) {
+        const size_t payload = 32 + sizeof(measurement.temperatures);
+        auto data = std::make_shared<std::string>();
+        data->reserve(4 + payload);
+        // FIN and binary opcode, unmasked, 16 bit length
+        data->push_back(static_cast<char>(0x82));
+        data->push_back(126);
+        data->push_back(static_cast<char>(payload >> 8));
+        data->push_back(static_cast<char>(payload & 0xFF));
+        const float body = measurement.is_measuring ? measurement.mean_temp_lpf + 5.6f : NAN;
+        // Width and height: the sensor rows are SENSOR_H pixels long
+        const uint16_t size[2] = {SENSOR_H, SENSOR_W};
+        const uint32_t reserved = 0;
+        data->append(reinterpret_cast<const char *>(&measurement.frame_no), 8);
+        data->append(reinterpret_cast<const char *>(&measurement.time_ms), 8);
+        data->append(reinterpret_cast<const char *>(&measurement.ambient_temp), 4);
+        data->append(reinterpret_cast<const char *>(&body), 4);
+        data->append(reinterpret_cast<const char *>(size), 4);
+        data->append(reinterpret_cast<const char *>(&reserved), 4);
+        data->append(reinterpret_cast<const char *>(measurement.temperatures), sizeof(measurement.temperatures));
+        message = data;
+    }
+    Metrics::instance().set("stream_frame_prepare_ms", std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count());
+    for (auto it = clients.begin(); it != clients.end();) {
+        // queue() may close the client
+        const int fd = it->first;
+        Client &client = it->second;
+        ++it;
+        if (client.kind == CLIENT_MJPEG && part) {
+            queue(fd, client, part);
+        } else if (client.kind == CLIENT_WEBSOCKET && message) {
+            queue(fd, client, message);
+        }
+    }
+}
+
+void StreamServer::queue(int fd, Client &client, std::shared_ptr<const std::string> data) {
+    if (client.sending) {
+        if (client.next) {
+            Metrics::instance().add("stream_frames_dropped_total");
+        }
+        client.next = std::move(data);
+        return;
+    }
+    client.sending = std::move(data);
+    client.offset = 0;
+    flush(fd, client);
+}
+
+bool StreamServer::flush(int fd, Client &client) {
+    while (client.sending) {
+        const ssize_t n = send(fd, client.sending->data() + client.offset, client.sending->size() - client.offset,
+                               MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!client.waiting_writable) {
+                epoll_event event = {};
+                event.events = EPOLLIN | EPOLLOUT;
+                event.data.fd = fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+                client.waiting_writable = true;
+            }
+            return true;
+        }
+        if (n < 0) {
+            close_client(fd);
+            return false;
+        }
+        client.offset += static_cast<size_t>(n);
+        if (client.offset < client.sending->size()) {
+            continue;
+        }
+        if (client.kind != CLIENT_REQUEST) {
+            Metrics::instance().add("stream_frames_sent_total");
+        }
+        client.sending = std::move(client.next);
+        client.next = nullptr;
+        client.offset = 0;
+    }
+    if (client.close_when_sent) {
+        close_client(fd);
+        return false;
+    }
+    if (client.waiting_writable) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+        client.waiting_writable = false;
+    }
+    return true;
+}
+
+void StreamServer::read_client(int fd, Client &client) {
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        if (client.kind == CLIENT_MJPEG) {
+            continue;
+        }
+        client.input.append(buffer, static_cast<size_t>(n));
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        close_client(fd);
+        return;
+    }
+    if (client.kind == CLIENT_REQUEST) {
+        if (client.input.find("\r\n\r\n") != std::string::npos) {
+            handle_request(fd, client);
+        } else if (client.input.size() > MAX_REQUEST) {
+            close_client(fd);
+        }
+        return;
+    }
+    // WebSocket: the viewers only send control frames; a close frame (or anything unexpected) ends the stream
+    while (client.kind == CLIENT_WEBSOCKET && client.input.size() >= 2) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(client.input.data());
+        const int opcode = bytes[0] & 0x0F;
+        uint64_t length = bytes[1] & 0x7F;
+        size_t header = 2;
+        if (length == 126) {
+            header = 4;
+        } else if (length == 127) {
+            header = 10;
+        }
+        if (client.input.size() < header) {
+            return;
+        }
+        if (length >= 126) {
+            length = 0;
+            for (size_t i = 2; i < header; i++) {
+                length = (length << 8) | bytes[i];
+            }
+        }
+        header += (bytes[1] & 0x80) ? 4 : 0;
+        if (opcode == 0x8 || length > MAX_REQUEST) {
+            close_client(fd);
+            return;
+        }
+        if (client.input.size() < header + length) {
+            return;
+        }
+        client.input.erase(0, header + length);
+    }
+}
+
+void StreamServer::handle_request(int fd, Client &client) {
+    const std::string request = client.input.substr(0, client.input.find("\r\n\r\n") + 2);
+    client.input.clear();
+    std::istringstream line(request);
+    std::string method, target;
+    line >> method >> target;
+    const size_t question = target.find('?');
+    const std::string path = target.substr(0, question);
+    const std::string query = question == std::string::npos ? "" : target.substr(question + 1);
+    if (!authorized(query)) {
+        client.close_when_sent = true;
+        queue(fd, client, response("403 Forbidden", "text/plain", "Token no válido\n"));
+    } else if (method != "GET") {
+        client.close_when_sent = true;
+        queue(fd, client, response("405 Method Not Allowed", "text/plain", "Solo GET\n"));
+    } else if (path == "/" || path == "/index.html") {
+        client.close_when_sent = true;
+        queue(fd, client, response("200 OK", "text/html; charset=utf-8", INDEX_PAGE));
+    } else if (path == "/snapshot.jpg") {
+        Measurement measurement;
+        std::shared_ptr<const std::string> jpeg = snapshot.jpeg(measurement);
+        client.close_when_sent = true;
+        queue(fd, client, jpeg ? response("200 OK", "image/jpeg", *jpeg)
+                               : response("503 Service Unavailable", "text/plain", "Sin lecturas\n"));
+    } else if (path == "/stream.mjpg") {
+        client.kind = CLIENT_MJPEG;
+        queue(fd, client, std::make_shared<const std::string>(
+                std::string("HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=") + BOUNDARY +
+                "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n"));
+    } else if (path == "/ws" && strcasecmp(header_value(request, "Upgrade").c_str(), "websocket") == 0 &&
+               !header_value(request, "Sec-WebSocket-Key").empty()) {
+        client.kind = CLIENT_WEBSOCKET;
+        queue(fd, client, std::make_shared<const std::string>(
+                "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: " + websocket_accept(header_value(request, "Sec-WebSocket-Key")) + "\r\n\r\n"));
+    } else {
+        client.close_when_sent = true;
+        queue(fd, client, response("404 Not Found", "text/plain", "No encontrado\n"));
+    }
+}
+
+void StreamServer::close_client(int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    clients.erase(fd);
+    Metrics::instance().set("stream_clients", static_cast<double>(clients.size()));
+}
@@ -0,0 +1,113 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_STREAMSERVER_H
+#define THERMALCAM_STREAMSERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include "LiveMeasurement.h"
+#include "LiveSnapshot.h"
+
+// Embedded HTTP server for watching the camera remotely:
+//   /             page with the stream and the temperatures
+//   /stream.mjpg  colorized frames as MJPEG (multipart/x-mixed-replace)
+//   /snapshot.jpg latest colorized frame
+//   /ws           WebSocket with one binary message per frame: frame_no (u64), time_ms (i64), ambient (f32),
+//                 body temperature (f32, NaN when nobody is measured), width and height (u16), 4 reserved bytes,
+//                 then width x height temperatures (f32, sensor order), all little endian
+//
+// Listens on bind_address; with a token, every request must carry it as ?token=... (the page passes its own query
+// on to the stream and the WebSocket). Listening beyond the loopback interface requires a token.
+//
+// One thread serves every client with non-blocking sockets and epoll. Each frame is encoded once per format, and
+// the clients share it by reference. A client holds at most the frame it is sending and the latest one: a slow
+// client skips frames, it never queues them, and the camera loop only signals an eventfd.
+class StreamServer {
+
+public:
+    StreamServer(const LiveMeasurement &live, LiveSnapshot &snapshot, const std::string &bind_address, uint16_t port,
+                 const std::string &token);
+
+    virtual ~StreamServer();
+
+    // Camera thread, after a measurement is published. Never blocks.
+    void notify();
+
+private:
+    static const size_t MAX_CLIENTS = 32;
+    static const size_t MAX_REQUEST = 8192;
+    // Clients that have not sent a complete request (or not read the response) by then are closed, so idle
+    // connections cannot hold every slot
+    const std::chrono::seconds REQUEST_TIMEOUT = std::chrono::seconds(5);
+
+    enum ClientKind {
+        CLIENT_REQUEST,
+        CLIENT_MJPEG,
+        CLIENT_WEBSOCKET,
+    };
+
+    struct Client {
+        ClientKind kind = CLIENT_REQUEST;
+        std::chrono::steady_clock::time_point accepted;
+        std::string input;
+        // Data being sent, and the latest frame waiting behind it
+        std::shared_ptr<const std::string> sending;
+        size_t offset = 0;
+        std::shared_ptr<const std::string> next;
+        bool close_when_sent = false;
+        bool waiting_writable = false;
+    };
+
+    const LiveMeasurement &live;
+    LiveSnapshot &snapshot;
+    const std::string token;
+    int listen_fd;
+    int event_fd;
+    int epoll_fd;
+    std::atomic<bool> stopping;
+    std::map<int, Client> clients;
+    std::thread thread;
+
+    void run();
+
+    void accept_clients();
+
+    void close_idle_clients();
+
+    bool authorized(const std::string &query) const;
+
+    void publish_frame();
+
+    void read_client(int fd, Client &client);
+
+    void handle_request(int fd, Client &client);
+
+    void queue(int fd, Client &client, std::shared_ptr<const std::string> data);
+
+    // Send until the socket would block. Returns false if the client was closed.
+    bool flush(int fd, Client &client);
+
+    void close_client(int fd);
+};
+
+
+#endif //THERMALCAM_STREAMSERVER_H
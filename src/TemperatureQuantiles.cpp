@@ -0,0 +1,110 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <sstream>
+#include <string>
+#include "Metrics.h"
+#include "TemperatureQuantiles.h"
+
+static const double EXPORTED_QUANTILES[] = {0.5, 0.95, 0.99};
+
+TemperatureQuantiles::TemperatureQuantiles()
+        : slots(DAY_SLOTS), closed_slot(-1), metrics_dirty(true), metrics_slot(-1) {
+}
+
+const char *TemperatureQuantiles::window_name(Window window) {
+    switch (window) {
+        case WINDOW_HOUR:
+            return "1h";
+        case WINDOW_DAY:
+            return "24h";
+        default:
+            return "all";
+    }
+}
+
+void TemperatureQuantiles::rotate(std::time_t slot) {
+    if (slot == closed_slot) {
+        return;
+    }
+    closed_hour.clear();
+    closed_day.clear();
+    for (std::time_t past = slot - static_cast<std::time_t>(DAY_SLOTS) + 1; past < slot; past++) {
+        const Slot &entry = slots[static_cast<size_t>(past % static_cast<std::time_t>(DAY_SLOTS))];
+        if (entry.id != past) {
+            continue;
+        }
+        closed_day.merge(entry.sketch);
+        if (slot - past < static_cast<std::time_t>(HOUR_SLOTS)) {
+            closed_hour.merge(entry.sketch);
+        }
+    }
+    closed_slot = slot;
+}
+
+QuantileSketch TemperatureQuantiles::window_locked(Window window, std::time_t slot) {
+    if (window == WINDOW_ALL) {
+        return all_time;
+    }
+    rotate(slot);
+    QuantileSketch sketch = window == WINDOW_HOUR ? closed_hour : closed_day;
+    const Slot &current = slots[static_cast<size_t>(slot % static_cast<std::time_t>(DAY_SLOTS))];
+    if (current.id == slot) {
+        sketch.merge(current.sketch);
+    }
+    return sketch;
+}
+
+QuantileSketch TemperatureQuantiles::window(Window window, std::time_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return window_locked(window, now / SLOT_SECONDS);
+}
+
+void TemperatureQuantiles::add(float temp, std::time_t now) {
+    const std::time_t slot = now / SLOT_SECONDS;
+    std::lock_guard<std::mutex> lock(mutex);
+    Slot &current = slots[static_cast<size_t>(slot % static_cast<std::time_t>(DAY_SLOTS))];
+    if (current.id != slot) {
+        // Reuse the slot of the previous day
+        current.id = slot;
+        current.sketch.clear();
+    }
+    current.sketch.add(temp);
+    all_time.add(temp);
+    metrics_dirty = true;
+}
+
+void TemperatureQuantiles::export_metrics(std::time_t now) {
+    const std::time_t slot = now / SLOT_SECONDS;
+    std::lock_guard<std::mutex> lock(mutex);
+    // The windows only change with a new measurement or when they slide by a slot
+    if (!metrics_dirty && slot == metrics_slot) {
+        return;
+    }
+    metrics_dirty = false;
+    metrics_slot = slot;
+    for (int w = 0; w < N_WINDOWS; w++) {
+        const Window window = static_cast<Window>(w);
+        const QuantileSketch sketch = window_locked(window, slot);
+        const std::string labels = std::string("{window=\"") + window_name(window) + "\"";
+        Metrics::instance().set("temperature_samples" + labels + "}", static_cast<double>(sketch.count()));
+        for (double q : EXPORTED_QUANTILES) {
+            std::ostringstream name;
+            name << "temperature_quantile" << labels << ",quantile=\"" << q << "\"}";
+            Metrics::instance().set(name.str(), sketch.quantile(q));
+        }
+    }
+}
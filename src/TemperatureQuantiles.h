@@ -0,0 +1,79 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_TEMPERATUREQUANTILES_H
+#define THERMALCAM_TEMPERATUREQUANTILES_H
+
+#include <ctime>
+#include <mutex>
+#include <vector>
+#include "QuantileSketch.h"
+
+// Distribution of the measured temperatures over the last hour, the last day and since startup. The day is
+// split in SLOT_SECONDS slots with a sketch each; a window is the merge of its slots, and the closed slots of
+// each window are merged once per slot so adding a measurement and querying stay cheap.
+class TemperatureQuantiles {
+
+public:
+    enum Window {
+        WINDOW_HOUR,
+        WINDOW_DAY,
+        WINDOW_ALL,
+        N_WINDOWS
+    };
+
+    static const std::time_t SLOT_SECONDS = 600;
+    static const size_t DAY_SLOTS = 86400 / SLOT_SECONDS;
+    static const size_t HOUR_SLOTS = 3600 / SLOT_SECONDS;
+
+    TemperatureQuantiles();
+
+    // Camera thread, once per completed measurement.
+    void add(float temp, std::time_t now);
+
+    // Refresh the temperature_quantile and temperature_samples metrics. Call periodically, so the windows slide
+    // when nobody is measured; does nothing until a measurement is added or the current slot changes.
+    void export_metrics(std::time_t now);
+
+    // Sketch of the window ending now. The hour and day windows start at a slot boundary, so they cover between
+    // one slot less and their full length.
+    QuantileSketch window(Window window, std::time_t now);
+
+    static const char *window_name(Window window);
+
+private:
+    struct Slot {
+        std::time_t id = -1;
+        QuantileSketch sketch;
+    };
+
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    QuantileSketch all_time;
+    // Closed slots of the hour and day windows, valid while closed_slot is the current slot
+    QuantileSketch closed_hour;
+    QuantileSketch closed_day;
+    std::time_t closed_slot;
+    bool metrics_dirty;
+    std::time_t metrics_slot;
+
+    void rotate(std::time_t slot);
+
+    QuantileSketch window_locked(Window window, std::time_t slot);
+};
+
+
+#endif //THERMALCAM_TEMPERATUREQUANTILES_H
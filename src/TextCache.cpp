@@ -0,0 +1,188 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <vector>
+#include "TextCache.h"
+
+const std::string TextCache::ATLAS_CHARSET = " +-.0123456789\xB0" "C";
+
+TextCache::TextCache() {
+    renderer = nullptr;
+}
+
+TextCache::~TextCache() {
+    clean();
+}
+
+void TextCache::init(SDL_Renderer *_renderer) {
+    clean();
+    renderer = _renderer;
+}
+
+void TextCache::clean() {
+    for (auto &entry : labels) {
+        SDL_DestroyTexture(entry.second.texture);
+    }
+    labels.clear();
+    for (auto &entry : atlases) {
+        SDL_DestroyTexture(entry.second.texture);
+    }
+    atlases.clear();
+}
+
+uint32_t TextCache::pack(const SDL_Color &color) {
+    return (uint32_t) color.r << 24u | (uint32_t) color.g << 16u | (uint32_t) color.b << 8u | color.a;
+}
+
+bool TextCache::is_atlas_text(const std::string &text) const {
+    if (text.empty()) {
+        return false;
+    }
+    for (char c : text) {
+        // The temperature message is terminated with a newline, which is not drawn.
+        if (c != '\n' && ATLAS_CHARSET.find(c) == std::string::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const TextCache::Label *TextCache::label(const std::string &text, const SDL_Color &color, TTF_Font *font) {
+    LabelKey key(font, pack(color), text);
+    auto it = labels.find(key);
+    if (it != labels.end()) {
+        return &it->second;
+    }
+    if (labels.size() >= MAX_LABELS) {
+        for (auto &entry : labels) {
+            SDL_DestroyTexture(entry.second.texture);
+        }
+        labels.clear();
+    }
+    SDL_Surface *surf = TTF_RenderText_Solid(font, text.c_str(), color);
+    if (surf == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "TTF_RenderText_Solid() Failed: %s\n", TTF_GetError());
+        return nullptr;
+    }
+    Label entry = {SDL_CreateTextureFromSurface(renderer, surf), surf->w, surf->h};
+    SDL_FreeSurface(surf);
+    if (entry.texture == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTextureFromSurface() Failed: %s\n", SDL_GetError());
+        return nullptr;
+    }
+    return &labels.emplace(key, entry).first->second;
+}
+
+const TextCache::Atlas *TextCache::atlas(const SDL_Color &color, TTF_Font *font) {
+    AtlasKey key(font, pack(color));
+    auto it = atlases.find(key);
+    if (it != atlases.end()) {
+        return &it->second;
+    }
+    // Render every glyph once and pack them side by side into a single texture.
+    Atlas entry = {};
+    entry.height = TTF_FontHeight(font);
+    std::vector<SDL_Surface *> glyph_surfaces;
+    int atlas_width = 0;
+    for (char c : ATLAS_CHARSET) {
+        const char glyph_text[2] = {c, '\0'};
+        SDL_Surface *glyph = TTF_RenderText_Solid(font, glyph_text, color);
+        glyph_surfaces.push_back(glyph);
+        if (glyph != nullptr) {
+            atlas_width += glyph->w;
+            entry.height = glyph->h > entry.height ? glyph->h : entry.height;
+        }
+    }
+    SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(0, atlas_width, entry.height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (sheet == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateRGBSurface() Failed: %s\n", SDL_GetError());
+        for (SDL_Surface *glyph : glyph_surfaces) {
+            SDL_FreeSurface(glyph);
+        }
+        return nullptr;
+    }
+    SDL_FillRect(sheet, nullptr, SDL_MapRGBA(sheet->format, 0, 0, 0, 0));
+    int x = 0;
+    for (size_t i = 0; i < ATLAS_CHARSET.size(); i++) {
+        SDL_Surface *glyph = glyph_surfaces[i];
+        if (glyph == nullptr) {
+            continue;
+        }
+        const auto index = static_cast<unsigned char>(ATLAS_CHARSET[i]);
+        SDL_Rect dst = {x, 0, glyph->w, glyph->h};
+        SDL_BlitSurface(glyph, nullptr, sheet, &dst);
+        entry.glyphs[index] = dst;
+        entry.has_glyph[index] = true;
+        x += glyph->w;
+        SDL_FreeSurface(glyph);
+    }
+    entry.texture = SDL_CreateTextureFromSurface(renderer, sheet);
+    SDL_FreeSurface(sheet);
+    if (entry.texture == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTextureFromSurface() Failed: %s\n", SDL_GetError());
+        return nullptr;
+    }
+    SDL_SetTextureBlendMode(entry.texture, SDL_BLENDMODE_BLEND);
+    return &atlases.emplace(key, entry).first->second;
+}
+
+SDL_Point TextCache::measure(const std::string &text, const SDL_Color &color, TTF_Font *font) {
+    if (is_atlas_text(text)) {
+        const Atlas *a = atlas(color, font);
+        if (a == nullptr) {
+            return {0, 0};
+        }
+        int width = 0;
+        for (char c : text) {
+            const auto index = static_cast<unsigned char>(c);
+            if (a->has_glyph[index]) {
+                width += a->glyphs[index].w;
+            }
+        }
+        return {width, a->height};
+    }
+    const Label *l = label(text, color, font);
+    if (l == nullptr) {
+        return {0, 0};
+    }
+    return {l->width, l->height};
+}
+
+void TextCache::draw(const std::string &text, const SDL_Color &color, TTF_Font *font, int x, int y) {
+    if (is_atlas_text(text)) {
+        const Atlas *a = atlas(color, font);
+        if (a == nullptr) {
+            return;
+        }
+        for (char c : text) {
+            const auto index = static_cast<unsigned char>(c);
+            if (!a->has_glyph[index]) {
+                continue;
+            }
+            const SDL_Rect &src = a->glyphs[index];
+            SDL_Rect dst = {x, y, src.w, src.h};
+            SDL_RenderCopy(renderer, a->texture, &src, &dst);
+            x += src.w;
+        }
+        return;
+    }
+    const Label *l = label(text, color, font);
+    if (l == nullptr) {
+        return;
+    }
+    SDL_Rect dst = {x, y, l->width, l->height};
+    SDL_RenderCopy(renderer, l->texture, nullptr, &dst);
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_TEXTCACHE_H
+#define THERMALCAM_TEXTCACHE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+// Cache of rendered text for the overlay. Static labels are rendered once and kept as textures,
+// changing temperature readings are composed from a prebuilt glyph atlas, so no surface or
+// texture is created per frame.
+class TextCache {
+
+public:
+    TextCache();
+
+    virtual ~TextCache();
+
+    void init(SDL_Renderer *renderer);
+
+    void clean();
+
+    // Size in pixels of the text as it will be drawn by draw().
+    SDL_Point measure(const std::string &text, const SDL_Color &color, TTF_Font *font);
+
+    void draw(const std::string &text, const SDL_Color &color, TTF_Font *font, int x, int y);
+
+private:
+
+    // Characters available in the glyph atlas: digits, sign, decimal point and the "°C" suffix
+    // (Latin-1, as used by TTF_RenderText_*).
+    static const std::string ATLAS_CHARSET;
+    // Upper bound on persistent label textures, in case a caller passes ever-changing strings.
+    static const size_t MAX_LABELS = 64;
+
+    struct Label {
+        SDL_Texture *texture;
+        int width;
+        int height;
+    };
+
+    struct Atlas {
+        SDL_Texture *texture;
+        SDL_Rect glyphs[256];
+        bool has_glyph[256];
+        int height;
+    };
+
+    typedef std::tuple<TTF_Font *, uint32_t, std::string> LabelKey;
+    typedef std::tuple<TTF_Font *, uint32_t> AtlasKey;
+
+    SDL_Renderer *renderer;
+    std::map<LabelKey, Label> labels;
+    std::map<AtlasKey, Atlas> atlases;
+
+    static uint32_t pack(const SDL_Color &color);
+
+    bool is_atlas_text(const std::string &text) const;
+
+    const Label *label(const std::string &text, const SDL_Color &color, TTF_Font *font);
+
+    const Atlas *atlas(const SDL_Color &color, TTF_Font *font);
+};
+
+
+#endif //THERMALCAM_TEXTCACHE_H
@@ -16,13 +16,17 @@ limitations under the License.
 */
 #include <chrono>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include "ThermalCamera.h"
 #include "constants.h"
 #include "colormap.h"
+#include "Rasterizer.h"
+#include "AlertImage.h"
+#include <MLX90640_I2C_Driver.h>
 #include <ctime>
-#include <pigpio.h>
 #include <unistd.h>
 #include <thread>
 #include <vector>
@@ -38,19 +42,73 @@ using namespace TgBot;
 const std::string token = "Your token";
 //Chat IDS para recibir alertas
 vector<std::string> chatIds = {"1584228134as", "987654321xy", "246813579zw"}; //ChatIDS
+//URL del API de Telegram; THERMALCAM_TELEGRAM_URL apunta a un servidor local (tools/telegram_mock) para pruebas
+static std::string telegramUrl() {
+    const char *url = getenv("THERMALCAM_TELEGRAM_URL");
+    return url != nullptr ? url : "https://api.telegram.org";
+}
+
+// Configuración del servidor de video: THERMALCAM_STREAM_BIND (p. ej. 0.0.0.0) y THERMALCAM_STREAM_TOKEN
+static std::string variableEntorno(const char *nombre, const std::string &porDefecto) {
+    const char *valor = getenv(nombre);
+    return valor != nullptr ? valor : porDefecto;
+}
 
 
 
-ThermalCamera::ThermalCamera() {
+ThermalCamera::ThermalCamera(bool _headless) : headless(_headless) {
+    window = nullptr;
+    renderer = nullptr;
+    texture = nullptr;
+    texture_r = nullptr;
+    slider = nullptr;
+    overlay_layer = nullptr;
+    font32 = nullptr;
+    font64 = nullptr;
     last_screenshot_time = std::chrono::steady_clock::now();
+#ifdef THERMALCAM_STUB_GPIO
+    buzzer.reset(new BuzzerService(std::unique_ptr<BuzzerBackend>(new StubBuzzerBackend())));
+#else
+    buzzer.reset(new BuzzerService(std::unique_ptr<BuzzerBackend>(new PigpioBuzzerBackend(BUZZER_PIN))));
+#endif
+    alert_journal.reset(new AlertJournal(ALERT_FOLDER + "/alertas.journal"));
+    alert_journal->open(ALERT_FOLDER);
+    // Pending alerts survive network outages and restarts in the outbox; the file_id of each uploaded photo is
+    // kept in the journal so the bot can resend it without uploading it again.
+    alert_dispatcher.reset(new AlertDispatcher(token, chatIds, ALERT_FOLDER + "/alertas.outbox",
+                                               [this](std::time_t time, const string& fileId) {
+                                                   alert_journal->set_file_id(time, fileId);
+                                               }, &alert_policy, telegramUrl()));
+    alert_store.reset(new AlertStore(ALERT_FOLDER, *alert_journal, ALERT_STORE_MAX_BYTES, ALERT_STORE_MAX_AGE));
+    alert_store->enforce();
+    snapshot_worker.reset(new AlertSnapshotWorker([this](const AlertSnapshot &snapshot) {
+        return alert_store->path_for(snapshot.time, ".png");
+    }));
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "=== ThermalCamera, Copyright 2020 Ava-X ===");
     char *base_path = SDL_GetBasePath();
     if (base_path) {
         resource_path = std::string(base_path) + "../resources";
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Resource path: %s\n", resource_path.c_str());
     }
-    init_sdl();
+    if (headless) {
+        // No window, renderer, fonts or images: only acquisition, measurement and alerting.
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Running headless");
+        init_layout(HEADLESS_WIDTH, HEADLESS_HEIGHT);
+    } else {
+        init_sdl();
+    }
     init_sensor();
+    history.open();
+    episode_stats.open();
+    if (STREAM_ENABLED) {
+        stream_server.reset(new StreamServer(live_measurement, live_snapshot,
+                                             variableEntorno("THERMALCAM_STREAM_BIND", STREAM_BIND_ADDRESS),
+                                             STREAM_PORT, variableEntorno("THERMALCAM_STREAM_TOKEN", "")));
+    }
+    if (RECORDING_ENABLED) {
+        // The EEPROM goes in every file, the raw words can be recalibrated later
+        recorder.reset(new Recorder(RECORDING_FOLDER, eeMLX90640, FPS, EMISSIVITY, RECORDING_MAX_BYTES));
+    }
     is_running = true;
     is_measuring = false;
     is_measuring_lpf = is_measuring;
@@ -59,10 +117,18 @@ ThermalCamera::ThermalCamera() {
     timer_is_animating = 0;
     animation_frame_nr = 0;
     frame_no = 0;
+    overlay_valid = false;
+    memset(pixels, 0, sizeof(pixels));
+    memset(pixels_presented, 0, sizeof(pixels_presented));
+    presents_done = 0;
+    presents_skipped = 0;
+    presents_report_time = std::chrono::steady_clock::now();
 
 }
 
 ThermalCamera::~ThermalCamera() {
+    // An alert still waiting for its post-roll is saved with the frames there are
+    finish_screenshot();
     clean();
 }
 
@@ -78,12 +144,15 @@ void ThermalCamera::init_sdl() {
         clean();
         exit(EXIT_FAILURE);
     }
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    // No SDL_RENDERER_PRESENTVSYNC: the main loop is paced by FramePacer, waiting for vsync as well would
+    // double-wait and drift against the sensor's refresh.
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (renderer == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateRenderer() Failed: %s\n", SDL_GetError());
         clean();
         exit(EXIT_FAILURE);
     }
+    text_cache.init(renderer);
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, SENSOR_W, SENSOR_H);
     if (texture == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTexture() Failed: %s\n", SDL_GetError());
@@ -132,6 +201,21 @@ void ThermalCamera::init_sdl() {
     }
     SDL_GetRendererOutputSize(renderer, &display_width, &display_height);
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Display dimension: (%d, %d)", display_width, display_height);
+    init_layout(display_width, display_height);
+    // Transparent layer holding the overlay, composed on top of the sensor image.
+    overlay_layer = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, display_width,
+                                      display_height);
+    if (overlay_layer == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTexture() Failed: %s\n", SDL_GetError());
+        clean();
+        exit(EXIT_FAILURE);
+    }
+    SDL_SetTextureBlendMode(overlay_layer, SDL_BLENDMODE_BLEND);
+}
+
+void ThermalCamera::init_layout(int width, int height) {
+    display_width = width;
+    display_height = height;
     // Set scaling and aspect ratio
     const double display_ratio = (double) display_width / display_height;
     const double sensor_ratio = (double) SENSOR_W / SENSOR_H;
@@ -186,6 +270,10 @@ void ThermalCamera::init_sensor() {
 }
 
 void ThermalCamera::clean() {
+    if (headless) {
+        return;
+    }
+    text_cache.clean();
     if (window != nullptr) {
         SDL_DestroyWindow(window);
     }
@@ -198,15 +286,42 @@ void ThermalCamera::clean() {
     if (texture_r != nullptr) {
         SDL_DestroyTexture(texture_r);
     }
+    if (overlay_layer != nullptr) {
+        SDL_DestroyTexture(overlay_layer);
+    }
     SDL_Quit();
 }
 
+// Poll the status register until the sensor flags a new subpage, so the frame pacer can observe the moment the
+// data became ready. Returns false if the data was already there on the first poll.
+bool ThermalCamera::wait_data_ready() const {
+    uint16_t status_register = 0;
+    bool waited = false;
+    auto t_start = std::chrono::steady_clock::now();
+    while (MLX90640_I2CRead(MLX_I2C_ADDR, 0x8000, 1, &status_register) == 0 && (status_register & 0x0008) == 0) {
+        waited = true;
+        if (std::chrono::steady_clock::now() - t_start > std::chrono::seconds(5)) {
+            // GetFrameData() reports the timeout
+            break;
+        }
+    }
+    return waited;
+}
+
 void ThermalCamera::update() {
     frame_no++;
-    auto start = std::chrono::system_clock::now();
-    MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
+    frame_read_start = std::chrono::steady_clock::now();
+    frame_read_waited = wait_data_ready();
+    frame_data_ready = std::chrono::steady_clock::now();
+    // Negative on an I2C error or a timeout; the frame buffer then holds a partial read, not worth recording
+    const int subpage = MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
+    if (recorder && subpage >= 0) {
+        recorder->record(frame, frame_no, std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+    }
 
-    eTa = MLX90640_GetTa(frame, &mlx90640) - 6.0f;
+    const float sensor_ta = MLX90640_GetTa(frame, &mlx90640);
+    eTa = sensor_ta - 6.0f;
     MLX90640_CalculateTo(frame, &mlx90640, EMISSIVITY, eTa, mlx90640To);
 
     MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
@@ -260,134 +375,417 @@ void ThermalCamera::update() {
         mean_temp_lpf = -1.0f;
     }
     // Format the temperature value to string
-    std::stringstream message_ss;
     if (mean_temp > MIN_MEASURE_RANGE && mean_temp < MAX_MEASURE_RANGE) {
-        message_ss << std::fixed << std::setprecision(1) << std::setw(4);
-        message_ss << mean_temp_lpf + 5.6 << "\xB0" << "C" << std::endl; //Ajuste
-        message = message_ss.str();
+        message = mensajeTemperatura(mean_temp_lpf);
     } else {
         message = "";
     }
+    const float values[N_SERIES] = {mean_temp > 0 ? mean_temp : NAN, mean_temp_lpf > 0 ? mean_temp_lpf : NAN,
+                                     static_cast<float>(n_samples), eTa, sensor_ta};
+    history.append(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count(), values);
+    publish_measurement();
+    // Slides the exported quantile windows also while nobody is measured
+    temperature_quantiles.export_metrics(time(nullptr));
+}
+
+string ThermalCamera::mensajeTemperatura(float temperatura) const {
+    std::stringstream message_ss;
+    message_ss << std::fixed << std::setprecision(1) << std::setw(4);
+    message_ss << temperatura + 5.6 << "\xB0" << "C" << std::endl; //Ajuste
+    return message_ss.str();
+}
+
+void ThermalCamera::publish_measurement() {
+    Measurement measurement;
+    measurement.frame_no = frame_no;
+    measurement.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    measurement.ambient_temp = eTa;
+    measurement.mean_temp_lpf = mean_temp_lpf;
+    measurement.is_measuring = is_measuring_lpf;
+    memcpy(measurement.temperatures, mlx90640To, sizeof(measurement.temperatures));
+    live_measurement.publish(measurement);
+    if (stream_server) {
+        stream_server->notify();
+    }
+    frame_ring.push(measurement);
+    if (pending_snapshot && frame_no >= pending_snapshot->frame_no + POST_ROLL_FRAMES) {
+        finish_screenshot();
+    }
 }
 
 
 void ThermalCamera::render() {
-
+    update_alert();
+    if (headless) {
+        return;
+    }
+    advance_animation();
+    // The overlay (slider, labels, animation) lives in its own layer and is only redrawn when one of its inputs
+    // changed. The whole frame is only composed and presented when the sensor image or the overlay changed.
+    const OverlayState state = overlay_state();
+    const bool overlay_dirty = !overlay_valid || !(state == overlay);
+    const bool sensor_dirty = memcmp(pixels, pixels_presented, sizeof(pixels)) != 0;
+    if (overlay_dirty) {
+        render_overlay();
+        overlay = state;
+        overlay_valid = true;
+    }
+    if (SKIP_UNCHANGED_PRESENT && !overlay_dirty && !sensor_dirty) {
+        presents_skipped++;
+        report_presents();
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
     render_sensor_frame();
+    SDL_RenderCopy(renderer, overlay_layer, nullptr, &rect_fullscreen);
+    memcpy(pixels_presented, pixels, sizeof(pixels));
+    SDL_RenderPresent(renderer);
+    presents_done++;
+    report_presents();
+}
+
+void ThermalCamera::render_overlay() const {
+    SDL_SetRenderTarget(renderer, overlay_layer);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
     if (is_measuring_lpf) {
         render_slider();
         render_temp_labels();
     } else {
         render_animation();
     }
-    SDL_RenderPresent(renderer);
-    //screenshot();
+    SDL_SetRenderTarget(renderer, nullptr);
+}
+
+ThermalCamera::OverlayState ThermalCamera::overlay_state() const {
+    OverlayState state;
+    state.is_measuring = is_measuring_lpf;
+    if (is_measuring_lpf) {
+        state.message = message;
+        state.label = temp_label;
+        state.label_dark = mean_temp_lpf + 5.6 <= 32.0;
+        state.marker_x = slider_marker_x();
+        state.animation_frame_nr = -1;
+    } else {
+        state.label_dark = false;
+        state.marker_x = -1;
+        state.animation_frame_nr = animation_frame_nr;
+    }
+    return state;
+}
+
+void ThermalCamera::report_presents() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - presents_report_time < std::chrono::minutes(1)) {
+        return;
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Frames presented: %zu, presents skipped (unchanged): %zu in the last minute",
+                presents_done, presents_skipped);
+    presents_done = 0;
+    presents_skipped = 0;
+    presents_report_time = now;
 }
 
 void ThermalCamera::soundBuzzer() const {
-    std::thread buzzerThread([this]() {
-        if (gpioInitialise() < 0) {
-            std::cout << "Failed to initialize pigpio library." << std::endl;
-        }
+    // Non-blocking: the buzzer service plays the pattern, overlapping requests are dropped.
+    buzzer->request(BuzzerPattern::ALERT);
+}
+
+string ThermalCamera::tiempoActual(time_t currentTime) const{
+    // Convert the time to local time (localtime_r: the bot workers, the dispatcher and the snapshot worker call this
+    // concurrently, localtime() shares one static tm)
+    std::tm localTime = {};
+    localtime_r(&currentTime, &localTime);
+    // Format and print the local time
+    std::stringstream ss;
+    ss << put_time(&localTime, "%H:%M:%S %d/%m/%Y");
+    // Return the formatted time as a string
+    return ss.str();
+}
+
+std::string ThermalCamera::alertaDate(const std::string& filePath) const {
+    std::string fileName = std::filesystem::path(filePath).filename().string(); // Get the file name from the file path
+    std::string dateTimePart = fileName.substr(0, 6); // Extract the date part from the file name
+    std::string timePart = fileName.substr(7, 8); // Extract the time part from the file name
+    std::replace(timePart.begin(), timePart.end(), '.', ':');
+    dateTimePart.insert(2, "/"); // Insert a slash (/) at position 2
+    dateTimePart.insert(5, "/"); // Insert a slash (/) at position 5
+    dateTimePart += " " + timePart; // Append the time part
+    return dateTimePart;
+}
 
-        // Set up buzzer pin as output
-        gpioSetMode(BUZZER_PIN, PI_OUTPUT);
-
-        try {
-            // Loop 2 times
-            for (int i = 0; i < 2; i++) {
-                gpioWrite(BUZZER_PIN, 1);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 0);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 1);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 0);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 1);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 0);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 1);
-                usleep(50000);
-                gpioWrite(BUZZER_PIN, 0);
-                usleep(1000000);
+// Clasificar la lectura y disparar la alerta cuando la temperatura es muy alta
+void ThermalCamera::update_alert() {
+    auto current_time = std::chrono::steady_clock::now();
+    if (!is_measuring_lpf) {
+        // Fin del episodio de medición: sumarlo a las estadísticas y enviar el resumen si hubo alertas
+        EpisodeSummary summary;
+        if (alert_policy.on_episode_end(current_time, summary)) {
+            episode_stats.add(summary, time(nullptr));
+            temperature_quantiles.add(summary.peak_temp, time(nullptr));
+            if (summary.alerts > 0) {
+                send_summary(summary);
             }
-        } catch (...) {
-            // Handle any exceptions here
         }
+        return;
+    }
+    if (mean_temp_lpf > 0) {
+        alert_policy.observe(mean_temp_lpf + 5.6, current_time);
+    }
+    if (mean_temp_lpf + 5.6 <= 33.0) {
+        temp_label = "Baja";
+    } else if (mean_temp_lpf + 5.6 > 33.0 && mean_temp_lpf + 5.6 <= 36.2) {
+        temp_label = "Normal";
+    } else if (mean_temp_lpf + 5.6 > 36.2 && mean_temp_lpf + 5.6  <= 37.5) {
+        temp_label = "Alta";
+    } else if (mean_temp_lpf + 5.6 > 37.5) {
+        auto elapsed_time = std::chrono::duration_cast<std::chrono::seconds>(current_time - last_screenshot_time);
+        if (elapsed_time >= std::chrono::seconds(5)) {
+            temp_label = "Muy alta";
+            soundBuzzer();
+            last_screenshot_time = current_time;
+            // Only the first alert of an episode is captured and sent, the rest go into the episode summary.
+            // The alert image and clip are rendered from the frames around this one on the snapshot worker,
+            // which then sends it.
+            if (alert_policy.on_alert(mean_temp_lpf + 5.6, current_time)) {
+                screenshot();
+            }
+        } else {
+            temp_label = "Muy alta (Alerta Enviada)";
+        }
+    }
+}
 
-        // Cleanup pigpio library
-        gpioTerminate();
-    });
+// Archivo a subir por el bot: la versión reducida si existe, si no el original
+static string archivoEnvio(const string& original, const string& reducido) {
+    return std::filesystem::is_regular_file(reducido) ? reducido : original;
+}
 
-    buzzerThread.detach(); // Detach the thread to run independently
+void ThermalCamera::send_alert(const string& imagePath, std::time_t time) const {
+    Alert alert;
+    // Sin ruta la alerta sale solo con texto
+    if (!imagePath.empty()) {
+        alert.image_path = archivoEnvio(imagePath, alert_preview_path(imagePath));
+    }
+    alert.time = time;
+    // La hora del evento, no la del envío: tras un corte de red las alertas llegan con su hora original
+    alert.text = "¡Alerta temperatura alta!\nRegistrada a las: " + tiempoActual(time);
+    alert_dispatcher->post(alert);
 }
 
-string ThermalCamera::tiempoActual() const{
-    // Get the current time
-    time_t currentTime = time(nullptr);
-    // Convert the current time to local time
-    std::tm* localTime = localtime(&currentTime);
-    // Format and print the local time
+void ThermalCamera::send_summary(const EpisodeSummary& summary) const {
     std::stringstream ss;
-    ss << put_time(localTime, "%H:%M:%S %d/%m/%Y");
-    // Return the formatted time as a string
+    ss << "Fin de la alerta\nTemperatura máxima: " << std::fixed << std::setprecision(1) << summary.peak_temp << "°C"
+       << "\nDuración: " << summary.duration.count() << " s"
+       << "\nAlertas: " << summary.alerts
+       << "\nRegistrado a las: " << tiempoActual();
+    Alert alert;
+    alert.text = ss.str();
+    alert.time = time(nullptr);
+    alert_dispatcher->post(alert);
+}
+
+string ThermalCamera::leyendaAlerta(const AlertEntry& alerta) const {
+    std::stringstream ss;
+    ss << "Alerta enviada el: " << alertaDate(alerta.path);
+    if (!std::isnan(alerta.temp)) {
+        ss << " (" << std::fixed << std::setprecision(1) << alerta.temp << "°C)";
+    }
     return ss.str();
 }
 
-string ThermalCamera::tiempolocal_H() const{
-    time_t currentTime = time(nullptr);
-    std::tm* localTime = localtime(&currentTime);
+// Lectura en vivo para /temp y /snapshot
+string ThermalCamera::textoMedicion(const Measurement& medicion) const {
     std::stringstream ss;
-    ss << put_time(localTime, "%d%m%y");
+    ss << std::fixed << std::setprecision(1);
+    if (medicion.is_measuring) {
+        ss << "Temperatura corporal: " << medicion.mean_temp_lpf + 5.6 << "°C";
+    } else {
+        ss << "No hay nadie frente a la cámara";
+    }
+    ss << "\nTemperatura ambiente: " << medicion.ambient_temp << "°C"
+       << "\nLectura de las: " << tiempoActual(static_cast<time_t>(medicion.time_ms / 1000));
     return ss.str();
 }
 
-string ThermalCamera::tiempolocal_M() const{
-    time_t currentTime = time(nullptr);
-    std::tm* localTime = localtime(&currentTime);
+// Texto de /resumen para un día o un mes
+string ThermalCamera::textoResumen(const string& titulo, const StatsBucket& estadisticas) const {
     std::stringstream ss;
-    ss << std::put_time(localTime, "%m%y"); // Change the format to only include month and year
+    ss << std::fixed << std::setprecision(1) << titulo
+       << "\nPersonas medidas: " << estadisticas.visitors
+       << "\nAlertas: " << estadisticas.alerts << " (" << estadisticas.alert_visitors << " personas)";
+    if (estadisticas.visitors > 0) {
+        const int hora = estadisticas.peak_hour();
+        ss << "\nTemperatura máxima por persona: mediana " << estadisticas.percentile(0.5)
+           << "°C, p90 " << estadisticas.percentile(0.9) << "°C, p99 " << estadisticas.percentile(0.99)
+           << "°C, máxima " << estadisticas.max_temp << "°C"
+           << "\nHora de mayor afluencia: " << std::setfill('0') << std::setw(2) << hora << ":00-"
+           << std::setw(2) << (hora + 1) % 24 << ":00 (" << estadisticas.hours[hora] << " personas)";
+    }
     return ss.str();
 }
 
-string ThermalCamera::getLatestFile(const string& folderPath) const{
-    string latestFile;
-    filesystem::file_time_type latestTime;
-    for (const auto& entry : filesystem::directory_iterator(folderPath)) {
-        if (filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-            string fileName = entry.path().stem().string(); // Get the file name without extension
-            if (fileName.size() >= 15 && fileName.substr(0, 6) == tiempolocal_H()) {
-                string fileTimeStr = fileName.substr(7); // Extract the time part of the file name
-                tm fileTime = {};
-                istringstream ss(fileTimeStr);
-                ss >> get_time(&fileTime, "%H.%M");
-                if (!ss.fail()) {
-                    filesystem::file_time_type fileTimeStamp = filesystem::last_write_time(entry);
-                    if (latestFile.empty() || fileTimeStamp > latestTime) {
-                        latestTime = fileTimeStamp;
-                        latestFile = entry.path().string();
-                    }
-                }
+// Texto de /tendencia: temperatura ambiente y del sensor en el historial de mediciones, de desde_ms a ahora
+string ThermalCamera::textoTendencia(const string& titulo, int64_t desde_ms, int64_t ahora_ms) const {
+    std::vector<TimeSeriesPoint> puntos;
+    history.query(TimeSeriesStore::tier_for(desde_ms, ahora_ms, PUNTOS_TENDENCIA), desde_ms, ahora_ms, puntos,
+                  (1u << SERIES_AMBIENT) | (1u << SERIES_SENSOR_TA));
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << titulo;
+    const std::pair<TimeSeriesSeries, const char *> series[] = {{SERIES_AMBIENT, "Ambiente"},
+                                                                {SERIES_SENSOR_TA, "Sensor"}};
+    for (const auto& [serie, nombre] : series) {
+        double suma = 0;
+        uint64_t cuadros = 0;
+        float minima = INFINITY, maxima = -INFINITY;
+        for (const TimeSeriesPoint& punto : puntos) {
+            if (std::isnan(punto.mean[serie])) {
+                continue;
             }
+            suma += static_cast<double>(punto.mean[serie]) * punto.frames;
+            cuadros += punto.frames;
+            minima = std::fmin(minima, punto.min[serie]);
+            maxima = std::fmax(maxima, punto.max[serie]);
+        }
+        ss << "\n" << nombre << ": ";
+        if (cuadros == 0) {
+            ss << "sin datos";
+        } else {
+            ss << "media " << suma / static_cast<double>(cuadros) << "°C, mínima " << minima << "°C, máxima "
+               << maxima << "°C";
         }
     }
+    return ss.str();
+}
 
-    return latestFile;
+// Enviar a un chat las alertas de una consulta al journal. Se envía la vista previa con un botón para pedir la
+// imagen original, y se registra su file_id (el mismo derivado que sube el dispatcher) para reenviarla después
+// en grupos sin volver a subirla.
+void ThermalCamera::enviarAlertas(TgBot::Bot& bot, std::int64_t chatId,
+                                  const std::vector<AlertEntry>& alertas) const {
+    for (const AlertEntry& alerta : alertas) {
+        if (!std::filesystem::is_regular_file(alerta.path)) {
+            continue;
+        }
+        ensure_alert_derivatives(alerta.path);
+        // Las imágenes antiguas reciben aquí sus derivados: cuentan para el límite del almacén
+        const uint64_t bytes = AlertJournal::files_size(alerta.path);
+        if (bytes != alerta.bytes) {
+            alert_journal->set_bytes(alerta.time, bytes);
+        }
+        const string archivo = archivoEnvio(alerta.path, alert_preview_path(alerta.path));
+        TgBot::InlineKeyboardMarkup::Ptr keyboard;
+        if (archivo != alerta.path) {
+            TgBot::InlineKeyboardButton::Ptr original(new TgBot::InlineKeyboardButton);
+            original->text = "Original";
+            original->callbackData = "original:" + std::to_string(alerta.time);
+            keyboard.reset(new TgBot::InlineKeyboardMarkup);
+            keyboard->inlineKeyboard.push_back({original});
+        }
+        TgBot::Message::Ptr enviado = bot.getApi().sendPhoto(
+                chatId, TgBot::InputFile::fromFile(archivo, alert_mime_type(archivo)), leyendaAlerta(alerta), 0,
+                keyboard);
+        if (enviado && !enviado->photo.empty() && alerta.file_id.empty()) {
+            alert_journal->set_file_id(alerta.time, enviado->photo.back()->fileId);
+        }
+    }
 }
 
-std::string ThermalCamera::alertaDate(const std::string& filePath) const {
-    std::string fileName = std::filesystem::path(filePath).filename().string(); // Get the file name from the file path
-    std::string dateTimePart = fileName.substr(0, 6); // Extract the date part from the file name
-    std::string timePart = fileName.substr(7, 8); // Extract the time part from the file name
-    std::replace(timePart.begin(), timePart.end(), '.', ':');
-    dateTimePart.insert(2, "/"); // Insert a slash (/) at position 2
-    dateTimePart.insert(5, "/"); // Insert a slash (/) at position 5
-    dateTimePart += " " + timePart; // Append the time part
-    return dateTimePart;
+// Consultas fijas de los comandos y botones: 'd' hoy, 'm' este mes, 't' todas, 'u' la última
+static AlertQuery consultaFija(char tipo, time_t ahora) {
+    AlertQuery consulta;
+    consulta.kind = tipo;
+    if (tipo == 'd') {
+        consulta.from = AlertJournal::start_of_day(ahora);
+        consulta.to = AlertJournal::start_of_next_day(ahora);
+    } else if (tipo == 'm') {
+        consulta.from = AlertJournal::start_of_month(ahora);
+        consulta.to = AlertJournal::start_of_next_month(ahora);
+    } else if (tipo == 'u') {
+        consulta.limit = 1;
+        consulta.newest_first = true;
+    }
+    return consulta;
+}
+
+static string textoSinAlertas(char tipo) {
+    switch (tipo) {
+        case 'd': return "No se encuentran alertas el día de hoy.";
+        case 'm': return "No se encuentran alertas este mes.";
+        case 'c': return "No hay alertas que cumplan la consulta.";
+        default: return "No hay alertas registradas.";
+    }
+}
+
+static string textoFin(char tipo) {
+    switch (tipo) {
+        case 'd': return "Fin de alertas diarias";
+        case 'm': return "Fin de alertas mensuales";
+        case 'c': return "Fin de la consulta";
+        default: return "Fin de todas las alertas";
+    }
+}
+
+// Responder una consulta al journal. La última alerta se envía como vista previa; las listas se envían por
+// páginas: grupos de hasta ALERTAS_POR_PAGINA fotos, reenviadas por su file_id, y un botón para la página
+// siguiente que lleva la consulta codificada.
+void ThermalCamera::responderConsulta(TgBot::Bot& bot, std::int64_t chatId, const AlertQuery& consulta,
+                                      size_t inicio, const BotExecutor::Cancelled& cancelado) const {
+    const std::vector<AlertEntry> alertas = alert_journal->query(consulta);
+    if (inicio >= alertas.size()) {
+        bot.getApi().sendMessage(chatId, textoSinAlertas(consulta.kind));
+        return;
+    }
+    if (consulta.kind == 'u') {
+        enviarAlertas(bot, chatId, alertas);
+        return;
+    }
+    const size_t fin = std::min(alertas.size(), inicio + ALERTAS_POR_PAGINA);
+    std::vector<TgBot::InputMedia::Ptr> grupo;
+    auto enviarGrupo = [&bot, chatId, &grupo]() {
+        if (grupo.size() == 1) {
+            bot.getApi().sendPhoto(chatId, grupo.front()->media, grupo.front()->caption);
+        } else if (grupo.size() > 1) {
+            bot.getApi().sendMediaGroup(chatId, grupo);
+        }
+        grupo.clear();
+    };
+    for (size_t i = inicio; i < fin; i++) {
+        if (cancelado()) {
+            // Otra consulta del mismo chat la reemplazó
+            return;
+        }
+        const AlertEntry& alerta = alertas[i];
+        if (alerta.file_id.empty()) {
+            // Nunca se subió (importada, o rechazada o caducada en el dispatcher): se envía sola la vista previa
+            // y queda registrado su file_id, así las consultas siguientes la agrupan
+            enviarGrupo();
+            enviarAlertas(bot, chatId, {alerta});
+            continue;
+        }
+        TgBot::InputMediaPhoto::Ptr foto(new TgBot::InputMediaPhoto);
+        foto->media = alerta.file_id;
+        foto->caption = leyendaAlerta(alerta);
+        grupo.push_back(foto);
+    }
+    enviarGrupo();
+    if (cancelado()) {
+        return;
+    }
+    if (fin < alertas.size()) {
+        TgBot::InlineKeyboardButton::Ptr siguiente(new TgBot::InlineKeyboardButton);
+        siguiente->text = "Página siguiente";
+        siguiente->callbackData = "pag:" + consulta.encode() + ":" + std::to_string(fin);
+        TgBot::InlineKeyboardMarkup::Ptr keyboard(new TgBot::InlineKeyboardMarkup);
+        keyboard->inlineKeyboard.push_back({siguiente});
+        bot.getApi().sendMessage(chatId, "Alertas " + std::to_string(inicio + 1) + " a " + std::to_string(fin) +
+                                         " de " + std::to_string(alertas.size()), false, 0, keyboard);
+    } else {
+        bot.getApi().sendMessage(chatId, textoFin(consulta.kind));
+    }
 }
 
 //Ajustar Lecturas de temperatura
@@ -413,49 +811,19 @@ void ThermalCamera::render_temp_labels() const {
     //origin.y -= 30;
     //
     origin = {0, 0};
-    
-    if (mean_temp_lpf + 5.6 <= 33.0) {
-        label = "Baja";
-    } else if (mean_temp_lpf + 5.6 > 33.0 && mean_temp_lpf + 5.6 <= 36.2) {
-        label = "Normal";
-    } else if (mean_temp_lpf + 5.6 > 36.2 && mean_temp_lpf + 5.6  <= 37.5) {
-        label = "Alta";
-    } else if (mean_temp_lpf + 5.6 > 37.5) {
-        auto current_time = std::chrono::steady_clock::now();
-        auto elapsed_time = std::chrono::duration_cast<std::chrono::seconds>(current_time - last_screenshot_time);
-        if (elapsed_time >= std::chrono::seconds(5)) {
-            label = "Muy alta";
-            render_text(label, text_color, origin, 3, font64);
-            soundBuzzer();
-            screenshot();
-            last_screenshot_time = current_time;
-            std::thread alertaThread([this]() {
-                const string folderFilePath = "/home/electronica/Pictures";
-                const string photoMimeType = "image/bmp";
-                TgBot::Bot bot(token);
-                for (const std::string& chatId : chatIds) {
-                bot.getApi().sendPhoto(chatId, TgBot::InputFile::fromFile(getLatestFile(folderFilePath), photoMimeType));
-                string tiempoAct = "¡Alerta temperatura alta!\nRegistrada a las: " + tiempoActual();
-                bot.getApi().sendMessage(chatId, tiempoAct);
-            }
-            });
-            alertaThread.detach();
-            
-        } else {
-            label = "Muy alta (Alerta Enviada)";
-        }
-    }
-    render_text(label, text_color, origin, 3, font64); //This one
+    render_text(temp_label, text_color, origin, 3, font64); //This one
 }
 
 void ThermalCamera::render_text(const std::string &text, const SDL_Color &text_color, const SDL_Point origin,
                            const int anchor,
                            TTF_Font *font) const {
-    SDL_Surface *surf = TTF_RenderText_Solid(font, text.c_str(), text_color);
-    SDL_Texture *texture_txt = SDL_CreateTextureFromSurface(renderer, surf);
-    int text_width, text_height;
-    SDL_QueryTexture(texture_txt, nullptr, nullptr, &text_width, &text_height);
-    SDL_Rect dst;
+    if (text.empty()) {
+        return;
+    }
+    const SDL_Point size = text_cache.measure(text, text_color, font);
+    const int text_width = size.x;
+    const int text_height = size.y;
+    SDL_Rect dst = {origin.x, origin.y, text_width, text_height};
     // top left
     if (anchor == 0) {
         dst = {origin.x, origin.y, text_width, text_height};
@@ -473,9 +841,7 @@ void ThermalCamera::render_text(const std::string &text, const SDL_Color &text_c
     else if (anchor == 3) {
         dst = {origin.x, display_height - text_height - origin.y, text_width, text_height};
     }
-    SDL_RenderCopy(renderer, texture_txt, nullptr, &dst);
-    SDL_FreeSurface(surf);
-    SDL_DestroyTexture(texture_txt);
+    text_cache.draw(text, text_color, font, dst.x, dst.y);
 }
 
 void ThermalCamera::render_sensor_frame() const {
@@ -503,10 +869,7 @@ void ThermalCamera::render_slider() const {
     SDL_Rect rect_slider = {0, ys1, display_width, ys2 - ys1};
     SDL_RenderCopy(renderer, slider, nullptr, &rect_slider);
     // marker
-    auto x_pos = (mean_temp_lpf - 31+6) / (39 - 31);
-    x_pos = fmin(1.0, x_pos);
-    x_pos = fmax(0.0, x_pos);
-    int x_marker = static_cast<int>(round(x_pos * (float) display_width));
+    int x_marker = slider_marker_x();
 
     marker_rect = {x_marker - margin2, ys1 - margin2, ys2 - ys1 + 2 * margin2};
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
@@ -518,7 +881,21 @@ void ThermalCamera::render_slider() const {
 
 }
 
+int ThermalCamera::slider_marker_x() const {
+    return slider_marker_x(mean_temp_lpf);
+}
+
+int ThermalCamera::slider_marker_x(float temperature) const {
+    auto x_pos = (temperature - 31+6) / (39 - 31);
+    x_pos = fmin(1.0, x_pos);
+    x_pos = fmax(0.0, x_pos);
+    return static_cast<int>(round(x_pos * (float) display_width));
+}
+
 void ThermalCamera::handle_events() {
+    if (headless) {
+        return;
+    }
     SDL_Event event;
     SDL_PollEvent(&event);
     if (event.type == SDL_QUIT) {
@@ -543,12 +920,15 @@ void ThermalCamera::colormap(const int x, const int y, float v, float vmin, floa
     color_index = color_index > 255 ? 255 : color_index;
     color_index = color_index < 0 ? 0 : color_index;
     const uint offset = (y * SENSOR_W + x);
-    ColorMap cm = get_colormap_jet();
+    // Built once; constructing the colormap per pixel dominated update() when running headless.
+    static const ColorMap cm = get_colormap_jet();
     pixels[offset] = cm.b.at(color_index) << 16u | cm.g.at(color_index) << 8u | cm.r.at(color_index);
 }
 
-void ThermalCamera::render_animation() {
-
+void ThermalCamera::advance_animation() {
+    if (is_measuring_lpf) {
+        return;
+    }
     if (timer_is_animating > TIMER_THRESHOLD_FRAMES) {
         timer_is_animating = 0;
         animation_frame_nr++;
@@ -556,40 +936,211 @@ void ThermalCamera::render_animation() {
     } else {
         timer_is_animating++;
     }
+}
+
+void ThermalCamera::render_animation() const {
     SDL_Rect animation_rect = {0, output_height, display_width, display_height - output_height};
     SDL_RenderCopy(renderer, animation.at(animation_frame_nr), nullptr, &animation_rect);
 
 }
 
-void ThermalCamera::screenshot() const{
-    SDL_Surface *sshot = SDL_CreateRGBSurface(0, display_width, display_height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff,
-                                              0xff000000);
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, sshot->pixels, sshot->pitch);
-    std::time_t currentTime = std::time(nullptr);
-    std::tm* localTime = std::localtime(&currentTime);
-    std::stringstream ss;
-    ss << std::put_time(localTime,"%d%m%y_%H.%M.%S");
-    //ss << std::setfill('0') << std::setw(5) << frame_no;
-    auto filename = "/home/electronica/Pictures/" + ss.str() + ".bmp";
-    SDL_SaveBMP(sshot, filename.c_str());
-    SDL_FreeSurface(sshot);
+// Copy the temperatures and overlay state; rendering and encoding happen on the snapshot worker.
+// El disparo de la alerta guarda el estado de la pantalla; la imagen y el clip se generan cuando llegan los
+// cuadros posteriores (finish_screenshot)
+void ThermalCamera::screenshot() {
+    finish_screenshot();
+    std::unique_ptr<AlertSnapshot> snapshot(new AlertSnapshot());
+    snapshot->time = std::time(nullptr);
+    snapshot->frame_no = frame_no;
+    memcpy(snapshot->temperatures, mlx90640To, sizeof(snapshot->temperatures));
+    snapshot->colormap_min = MIN_COLORMAP_RANGE;
+    snapshot->colormap_max = MAX_COLORMAP_RANGE;
+    snapshot->is_measuring = is_measuring_lpf;
+    snapshot->mean_temp_lpf = mean_temp_lpf;
+    snapshot->ambient_temp = eTa;
+    snapshot->message = message;
+    snapshot->label = temp_label;
+    snapshot->marker_x = slider_marker_x();
+    snapshot->width = display_width;
+    snapshot->height = display_height;
+    const SDL_Rect &image_rect = preserve_aspect ? rect_preserve_aspect : rect_fullscreen;
+    snapshot->image_x = image_rect.x;
+    snapshot->image_y = image_rect.y;
+    snapshot->image_w = image_rect.w;
+    snapshot->image_h = image_rect.h;
+    snapshot->clip_trigger = 0;
+    pending_snapshot = std::move(snapshot);
+}
+
+void ThermalCamera::finish_screenshot() {
+    if (!pending_snapshot) {
+        return;
+    }
+    std::unique_ptr<AlertSnapshot> snapshot = std::move(pending_snapshot);
+    // Pre-roll and post-roll frames; one allocation per alert, none per frame
+    snapshot->clip.reserve(PRE_ROLL_FRAMES + POST_ROLL_FRAMES + 1);
+    frame_ring.copy_since(snapshot->frame_no > PRE_ROLL_FRAMES ? snapshot->frame_no - PRE_ROLL_FRAMES : 0,
+                          snapshot->clip);
+    // The still is the hottest measured frame of the clip, the trigger frame unless the reading kept rising
+    const Measurement *still = nullptr;
+    for (size_t i = 0; i < snapshot->clip.size(); i++) {
+        const Measurement &frame = snapshot->clip[i];
+        if (frame.frame_no == snapshot->frame_no) {
+            snapshot->clip_trigger = i;
+        }
+        if (frame.is_measuring && frame.mean_temp_lpf > snapshot->mean_temp_lpf &&
+            (still == nullptr || frame.mean_temp_lpf > still->mean_temp_lpf)) {
+            still = &frame;
+        }
+    }
+    if (still != nullptr) {
+        snapshot->frame_no = still->frame_no;
+        memcpy(snapshot->temperatures, still->temperatures, sizeof(snapshot->temperatures));
+        snapshot->mean_temp_lpf = still->mean_temp_lpf;
+        snapshot->ambient_temp = still->ambient_temp;
+        snapshot->message = mensajeTemperatura(still->mean_temp_lpf);
+        // The label ("Muy alta") holds for a hotter frame too, the marker moves with the reading
+        snapshot->marker_x = slider_marker_x(still->mean_temp_lpf);
+    }
+    // The image is best effort: the alert is sent as text when it cannot be queued or written
+    const std::time_t alert_time = snapshot->time;
+    bool queued = snapshot_worker->submit(std::move(snapshot), [this](const AlertSnapshot &s, const std::string &path) {
+        if (path.empty()) {
+            send_alert("", s.time);
+            return;
+        }
+        if (!alert_store->add(s.time, s.mean_temp_lpf + 5.6f, s.ambient_temp, path)) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Could not add %s to the alert journal", path.c_str());
+        }
+        send_alert(path, s.time);
+    });
+    if (!queued) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Alert snapshot queue full, alert sent without image");
+        send_alert("", alert_time);
+    }
 }
 
 // ----------------------------------------------------------------------Integracion del bot de telegram-------------------------------------------------------------------//
 void ThermalCamera::runbot() {
     
-    TgBot::Bot bot(token);
-    
-    const string folderFilePath = "/home/electronica/Pictures";
-    const string photoMimeType = "image/bmp";
+#ifdef HAVE_CURL
+    TgBot::CurlHttpClient httpClient;
+#else
+    TgBot::BoostHttpOnlySslClient httpClient;
+#endif
+    TgBot::Bot bot(token, httpClient, telegramUrl());
+    // Los comandos se atienden en BOT_WORKERS hilos, en orden por chat, sin bloquear el long polling
+    BotExecutor executor(BOT_WORKERS);
     
-    bot.getEvents().onCommand("start", [this, &bot](TgBot::Message::Ptr message) {
-        bot.getApi().sendMessage(message->chat->id, "Bot se encuentra enlazado");
+    bot.getEvents().onCommand("start", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "start", [&bot, message](const BotExecutor::Cancelled&) {
+            bot.getApi().sendMessage(message->chat->id, "Bot se encuentra enlazado");
+        });
     });
     
-    bot.getEvents().onCommand("tiempo", [this, &bot](TgBot::Message::Ptr message) {
-        string tiempoAct = "El tiempo actual es: " + tiempoActual();
-        bot.getApi().sendMessage(message->chat->id, tiempoAct);
+    bot.getEvents().onCommand("tiempo", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "tiempo", [this, &bot, message](const BotExecutor::Cancelled&) {
+            string tiempoAct = "El tiempo actual es: " + tiempoActual();
+            bot.getApi().sendMessage(message->chat->id, tiempoAct);
+        });
+    });
+
+    // Lecturas en vivo: se copian de la última medición publicada por el bucle de la cámara
+    bot.getEvents().onCommand("temp", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "temp", [this, &bot, message](const BotExecutor::Cancelled&) {
+            Measurement medicion;
+            if (!latest_measurement(medicion)) {
+                bot.getApi().sendMessage(message->chat->id, "Todavía no hay lecturas del sensor");
+                return;
+            }
+            bot.getApi().sendMessage(message->chat->id, textoMedicion(medicion));
+        });
+    });
+
+    bot.getEvents().onCommand("snapshot", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "snapshot", [this, &bot, message](const BotExecutor::Cancelled&) {
+            Measurement medicion;
+            std::shared_ptr<const string> imagen = live_snapshot.jpeg(medicion);
+            if (!imagen) {
+                bot.getApi().sendMessage(message->chat->id, "Todavía no hay lecturas del sensor");
+                return;
+            }
+            TgBot::InputFile::Ptr archivo(new TgBot::InputFile);
+            archivo->data = *imagen;
+            archivo->mimeType = "image/jpeg";
+            archivo->fileName = "snapshot_" + std::to_string(medicion.frame_no) + ".jpg";
+            bot.getApi().sendPhoto(message->chat->id, archivo, textoMedicion(medicion));
+        });
+    });
+    //RESUMEN: /resumen [AAAA-MM-DD | AAAA-MM], por defecto hoy y el mes actual
+    bot.getEvents().onCommand("resumen", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "resumen", [this, &bot, message](const BotExecutor::Cancelled&) {
+            const size_t espacio = message->text.find(' ');
+            const string argumento = espacio == string::npos ? "" : message->text.substr(espacio + 1);
+            std::tm fecha = {};
+            fecha.tm_hour = 12;
+            fecha.tm_isdst = -1;
+            StatsBucket estadisticas = {};
+            string texto;
+            if (argumento.empty()) {
+                const time_t ahora = time(nullptr);
+                texto = episode_stats.day(ahora, estadisticas) ? textoResumen("Resumen de hoy", estadisticas)
+                                                               : "Hoy no se ha medido a nadie";
+                texto += "\n\n";
+                texto += episode_stats.month(ahora, estadisticas) ? textoResumen("Resumen del mes", estadisticas)
+                                                                  : "Este mes no se ha medido a nadie";
+            } else if (sscanf(argumento.c_str(), "%4d-%2d-%2d", &fecha.tm_year, &fecha.tm_mon, &fecha.tm_mday) == 3) {
+                fecha.tm_year -= 1900;
+                fecha.tm_mon -= 1;
+                texto = episode_stats.day(mktime(&fecha), estadisticas)
+                        ? textoResumen("Resumen del " + argumento, estadisticas)
+                        : "No hay estadísticas del " + argumento + " (se guardan " +
+                          std::to_string(EpisodeStats::DAYS) + " días)";
+            } else if (sscanf(argumento.c_str(), "%4d-%2d", &fecha.tm_year, &fecha.tm_mon) == 2) {
+                fecha.tm_year -= 1900;
+                fecha.tm_mon -= 1;
+                fecha.tm_mday = 1;
+                texto = episode_stats.month(mktime(&fecha), estadisticas)
+                        ? textoResumen("Resumen de " + argumento, estadisticas)
+                        : "No hay estadísticas de " + argumento + " (se guardan " +
+                          std::to_string(EpisodeStats::MONTHS) + " meses)";
+            } else {
+                texto = "Uso: /resumen [AAAA-MM-DD | AAAA-MM]";
+            }
+            bot.getApi().sendMessage(message->chat->id, texto);
+        });
+    });
+    //PERCENTILES: distribución de las temperaturas medidas (máxima por persona)
+    bot.getEvents().onCommand("percentiles", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "percentiles", [this, &bot, message](const BotExecutor::Cancelled&) {
+            static const char *titulos[] = {"Última hora", "Últimas 24 horas", "Desde el arranque"};
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(1) << "Temperatura máxima por persona";
+            for (int ventana = 0; ventana < TemperatureQuantiles::N_WINDOWS; ventana++) {
+                const QuantileSketch sketch = temperature_quantiles.window(
+                        static_cast<TemperatureQuantiles::Window>(ventana), time(nullptr));
+                ss << "\n" << titulos[ventana] << ": ";
+                if (sketch.count() == 0) {
+                    ss << "sin mediciones";
+                } else {
+                    ss << sketch.count() << " personas, p50 " << sketch.quantile(0.5) << "°C, p95 "
+                       << sketch.quantile(0.95) << "°C, p99 " << sketch.quantile(0.99) << "°C";
+                }
+            }
+            bot.getApi().sendMessage(message->chat->id, ss.str());
+        });
+    });
+    //TENDENCIA: temperatura ambiente y del sensor según el historial de mediciones
+    bot.getEvents().onCommand("tendencia", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "tendencia", [this, &bot, message](const BotExecutor::Cancelled&) {
+            const int64_t ahora = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            const int64_t hora = 3600 * 1000;
+            bot.getApi().sendMessage(message->chat->id,
+                                     textoTendencia("Última hora", ahora - hora, ahora) + "\n\n" +
+                                     textoTendencia("Últimas 24 horas", ahora - 24 * hora, ahora) + "\n\n" +
+                                     textoTendencia("Últimos 7 días", ahora - 7 * 24 * hora, ahora));
+        });
     });
 /*
     bot.getEvents().onAnyMessage([this, &bot](TgBot::Message::Ptr message) {
@@ -601,7 +1152,7 @@ void ThermalCamera::runbot() {
     });
 */
 
-    bot.getEvents().onAnyMessage([this, &bot](TgBot::Message::Ptr message) {
+    bot.getEvents().onAnyMessage([this, &bot, &executor](TgBot::Message::Ptr message) {
         printf("User wrote %s\n", message->text.c_str());
 
         if (StringTools::startsWith(message->text, "/start") ||
@@ -611,239 +1162,179 @@ void ThermalCamera::runbot() {
         message->text == "/alertahoy" ||
         message->text == "/alertames" ||
         message->text == "/alertault" ||
+        StringTools::startsWith(message->text, "/alertas") ||
+        message->text == "/temp" ||
+        message->text == "/snapshot" ||
+        StringTools::startsWith(message->text, "/resumen") ||
+        message->text == "/percentiles" ||
+        message->text == "/tendencia" ||
         message->text == "/tiempo") {
         return;
         }
-        bot.getApi().sendMessage(message->chat->id, "Por favor utiliza el comando /menu para desplegar las opciones disponibles de la aplicación");
+        executor.submit(message->chat->id, "ayuda", [&bot, message](const BotExecutor::Cancelled&) {
+            bot.getApi().sendMessage(message->chat->id, "Por favor utiliza el comando /menu para desplegar las opciones disponibles de la aplicación");
+        });
     });
     
     //---------------------------------------------Alertas--------------------------------------------------------------
     {
+    // Las consultas del historial comparten la clave "historial": una nueva consulta cancela la anterior
     //TODOS
-    bot.getEvents().onCommand("folder", [this, &bot, &folderFilePath, &photoMimeType](TgBot::Message::Ptr message) {
-        for (const auto& entry : std::filesystem::directory_iterator(folderFilePath)) {
-            if (std::filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-                const string contenidoFilePath = entry.path().string();
-                string alertaEnv = alertaDate(contenidoFilePath);
-                bot.getApi().sendPhoto(message->chat->id, TgBot::InputFile::fromFile(contenidoFilePath, photoMimeType));
-                bot.getApi().sendMessage(message->chat->id, "Alerta enviada el: "+alertaEnv);
-            } else {
-            bot.getApi().sendMessage(message->chat->id, "No hay alertas registradas.");
-            }
-        }
-        bot.getApi().sendMessage(message->chat->id, "Fin de todas las alertas");
+    bot.getEvents().onCommand("folder", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "historial", [this, &bot, message](const BotExecutor::Cancelled& cancelado) {
+            responderConsulta(bot, message->chat->id, consultaFija('t', time(nullptr)), 0, cancelado);
+        });
     });
     //MENSUA
-    bot.getEvents().onCommand("alertames", [this, &bot, &folderFilePath, &photoMimeType](TgBot::Message::Ptr message) {
-        std::string currentMonth = tiempolocal_M(); // Get the current month and year
-        bool foundFiles = false;
-        for (const auto& entry : std::filesystem::directory_iterator(folderFilePath)) {
-            if (std::filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-                std::string fileName = entry.path().stem().string(); // Get the file name without extension
-                if (fileName.substr(2, 4) == currentMonth) { // Check if the month part matches the current month
-                    const std::string contenidoFilePath = entry.path().string();
-                    string alertaEnv = alertaDate(contenidoFilePath);
-                    bot.getApi().sendPhoto(message->chat->id, TgBot::InputFile::fromFile(contenidoFilePath, photoMimeType));
-                    bot.getApi().sendMessage(message->chat->id, "Alerta enviada el: "+alertaEnv);
-                    foundFiles = true; // Set the flag to true if at least one file is found
-                }
-            }
-        }
-        
-        bot.getApi().sendMessage(message->chat->id, "Fin de alertas mensuales");
-
-        if (!foundFiles) {
-            bot.getApi().sendMessage(message->chat->id, "No se encuentran alertas este mes.");
-        }
+    bot.getEvents().onCommand("alertames", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "historial", [this, &bot, message](const BotExecutor::Cancelled& cancelado) {
+            responderConsulta(bot, message->chat->id, consultaFija('m', time(nullptr)), 0, cancelado);
+        });
     });
 
     //DIARIO
-    bot.getEvents().onCommand("alertahoy", [this, &bot, &folderFilePath, &photoMimeType](TgBot::Message::Ptr message) {
-        std::string currentDate = tiempolocal_H();
-        bool foundFiles = false;
-
-        for (const auto& entry : std::filesystem::directory_iterator(folderFilePath)) {
-            if (std::filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-                std::string fileName = entry.path().stem().string(); // Get the file name without extension
-                if (fileName.substr(0, 6) == currentDate) { // Check if the date part matches the current date
-                    const std::string contenidoFilePath = entry.path().string();
-                    string alertaEnv = alertaDate(contenidoFilePath);
-                    bot.getApi().sendPhoto(message->chat->id, TgBot::InputFile::fromFile(contenidoFilePath, photoMimeType));
-                    bot.getApi().sendMessage(message->chat->id, "Alerta enviada el: "+alertaEnv);
-                    foundFiles = true; // Set the flag to true if at least one file is found
-                }
-            }
-        }
-        
-        bot.getApi().sendMessage(message->chat->id, "Fin de alertas diarias");
-
-        if (!foundFiles) {
-            bot.getApi().sendMessage(message->chat->id, "No se encuentran alertas el día de hoy.");
-        }
+    bot.getEvents().onCommand("alertahoy", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "historial", [this, &bot, message](const BotExecutor::Cancelled& cancelado) {
+            responderConsulta(bot, message->chat->id, consultaFija('d', time(nullptr)), 0, cancelado);
+        });
     });
 
     //ULTIMA
-    bot.getEvents().onCommand("alertault", [this, &bot, &folderFilePath, &photoMimeType](TgBot::Message::Ptr message) {
-        string latestFile = getLatestFile(folderFilePath);
-        string alertaEnv = alertaDate(latestFile);
-        if (!latestFile.empty()) {
-            bot.getApi().sendPhoto(message->chat->id, TgBot::InputFile::fromFile(latestFile, photoMimeType));
-            bot.getApi().sendMessage(message->chat->id, "Alerta enviada el: "+alertaEnv);
-        } else {
-            bot.getApi().sendMessage(message->chat->id, "No hay alertas registradas.");
-        }
+    bot.getEvents().onCommand("alertault", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "alertault", [this, &bot, message](const BotExecutor::Cancelled& cancelado) {
+            responderConsulta(bot, message->chat->id, consultaFija('u', time(nullptr)), 0, cancelado);
+        });
+    });
+
+    //CONSULTA: /alertas [hoy | mes | AAAA-MM | AAAA-MM-DD [AAAA-MM-DD]] [>T] [<T] [limite=N]
+    bot.getEvents().onCommand("alertas", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "historial", [this, &bot, message](const BotExecutor::Cancelled& cancelado) {
+            const size_t espacio = message->text.find(' ');
+            const string argumentos = espacio == string::npos ? "" : message->text.substr(espacio + 1);
+            AlertQuery consulta;
+            string error;
+            if (!AlertQuery::parse(argumentos, time(nullptr), consulta, error)) {
+                bot.getApi().sendMessage(message->chat->id, error + "\nUso: /alertas [hoy | mes | AAAA-MM | "
+                                         "AAAA-MM-DD [AAAA-MM-DD]] [>38] [<40] [limite=N]");
+                return;
+            }
+            responderConsulta(bot, message->chat->id, consulta, 0, cancelado);
+        });
     });
     }
 
     //-------------------------------------------------------Botones--------------------------------------------------
     {
-    bot.getEvents().onCommand("menu", [this, &bot](TgBot::Message::Ptr message) {
-        // Create an inline keyboard markup...
-        TgBot::InlineKeyboardMarkup::Ptr keyboard(new TgBot::InlineKeyboardMarkup);
-
-        //button 1
-        TgBot::InlineKeyboardButton::Ptr button1(new TgBot::InlineKeyboardButton);
-        button1->text = "Verificar enlace";
-        button1->callbackData = "button1";  // Callback data to identify the button
-        //button 2
-        TgBot::InlineKeyboardButton::Ptr button2(new TgBot::InlineKeyboardButton);
-        button2->text = "Tiempo local";
-        button2->callbackData = "button2";  
-        //button 3
-        TgBot::InlineKeyboardButton::Ptr button3(new TgBot::InlineKeyboardButton);
-        button3->text = "Última Alerta";
-        button3->callbackData = "button3";  
-        //button 4
-        TgBot::InlineKeyboardButton::Ptr button4(new TgBot::InlineKeyboardButton);
-        button4->text = "Alertas Diarias";
-        button4->callbackData = "button4";  
-        //button 5
-        TgBot::InlineKeyboardButton::Ptr button5(new TgBot::InlineKeyboardButton);
-        button5->text = "Alertas Mensuales";
-        button5->callbackData = "button5"; 
-        //button 6
-        TgBot::InlineKeyboardButton::Ptr button6(new TgBot::InlineKeyboardButton);
-        button6->text = "Todas Alertas";
-        button6->callbackData = "button6";   
-        // Create a vector to hold the rows of buttons
-        std::vector<TgBot::InlineKeyboardButton::Ptr> row1;
-        std::vector<TgBot::InlineKeyboardButton::Ptr> row2;
-        // Add the button to the row
-        row1.push_back(button1);
-        row1.push_back(button2);
-        row1.push_back(button3);
-        row2.push_back(button4);
-        row2.push_back(button5);
-        row2.push_back(button6);
-
-        // Add the row to the keyboard
-        keyboard->inlineKeyboard.push_back(row1);
-        keyboard->inlineKeyboard.push_back(row2);
-
-        // Create a message with the keyboard
-        std::string text = "Elige un botón para realizar una acción:";
-        bot.getApi().sendMessage(message->chat->id, text, false, 0, keyboard);
+    bot.getEvents().onCommand("menu", [this, &bot, &executor](TgBot::Message::Ptr message) {
+        executor.submit(message->chat->id, "menu", [&bot, message](const BotExecutor::Cancelled&) {
+            // Create an inline keyboard markup...
+            TgBot::InlineKeyboardMarkup::Ptr keyboard(new TgBot::InlineKeyboardMarkup);
+
+            //button 1
+            TgBot::InlineKeyboardButton::Ptr button1(new TgBot::InlineKeyboardButton);
+            button1->text = "Verificar enlace";
+            button1->callbackData = "button1";  // Callback data to identify the button
+            //button 2
+            TgBot::InlineKeyboardButton::Ptr button2(new TgBot::InlineKeyboardButton);
+            button2->text = "Tiempo local";
+            button2->callbackData = "button2";  
+            //button 3
+            TgBot::InlineKeyboardButton::Ptr button3(new TgBot::InlineKeyboardButton);
+            button3->text = "Última Alerta";
+            button3->callbackData = "button3";  
+            //button 4
+            TgBot::InlineKeyboardButton::Ptr button4(new TgBot::InlineKeyboardButton);
+            button4->text = "Alertas Diarias";
+            button4->callbackData = "button4";  
+            //button 5
+            TgBot::InlineKeyboardButton::Ptr button5(new TgBot::InlineKeyboardButton);
+            button5->text = "Alertas Mensuales";
+            button5->callbackData = "button5"; 
+            //button 6
+            TgBot::InlineKeyboardButton::Ptr button6(new TgBot::InlineKeyboardButton);
+            button6->text = "Todas Alertas";
+            button6->callbackData = "button6";   
+            // Create a vector to hold the rows of buttons
+            std::vector<TgBot::InlineKeyboardButton::Ptr> row1;
+            std::vector<TgBot::InlineKeyboardButton::Ptr> row2;
+            // Add the button to the row
+            row1.push_back(button1);
+            row1.push_back(button2);
+            row1.push_back(button3);
+            row2.push_back(button4);
+            row2.push_back(button5);
+            row2.push_back(button6);
+
+            // Add the row to the keyboard
+            keyboard->inlineKeyboard.push_back(row1);
+            keyboard->inlineKeyboard.push_back(row2);
+
+            // Create a message with the keyboard
+            std::string text = "Elige un botón para realizar una acción:";
+            bot.getApi().sendMessage(message->chat->id, text, false, 0, keyboard);
         });
+    });
 
         // Add the onCallbackQuery event handler here
-        bot.getEvents().onCallbackQuery([this, &bot](TgBot::CallbackQuery::Ptr query) {
-        std::string callbackData = query->data;
-        //Paths
-        
-        const string photoMimeType = "image/bmp";
-        const string folderFilePath = "/home/electronica/Pictures";
-        
-        // Check the callback data to identify the button clicked
-        if (callbackData == "button1") {
-        // Handle button 1 click
-            bot.getApi().sendMessage(query->message->chat->id, "El sistema se encuentra enlazado adecuadamente");
-
-        } else if (callbackData == "button2") {
-        // Handle button 2 click
-            string tiempoAct = "El tiempo actual del sistema es: " + tiempoActual();
-            bot.getApi().sendMessage(query->message->chat->id, tiempoAct);
-
-        } else if (callbackData == "button3") {
-        // Handle button 3 click
-            string latestFile = getLatestFile(folderFilePath);
-            string alertaEnv = alertaDate(latestFile);
-            if (!latestFile.empty()) {
-                bot.getApi().sendPhoto(query->message->chat->id, TgBot::InputFile::fromFile(latestFile, photoMimeType));
-                bot.getApi().sendMessage(query->message->chat->id, "Alerta enviada el: "+alertaEnv);
-            } else {
-                bot.getApi().sendMessage(query->message->chat->id, "No hay alertas registradas.");
-            }
-
-
-
-        } else if (callbackData == "button4") {
-        // Handle button 4 click
-            std::string currentDate = tiempolocal_H();
-            bool foundFiles = false;
-
-            for (const auto& entry : std::filesystem::directory_iterator(folderFilePath)) {
-                if (std::filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-                    std::string fileName = entry.path().stem().string(); // Get the file name without extension
-                    if (fileName.substr(0, 6) == currentDate) { // Check if the date part matches the current date
-                        const std::string contenidoFilePath = entry.path().string();
-                        string alertaEnv = alertaDate(contenidoFilePath);
-                        bot.getApi().sendPhoto(query->message->chat->id, TgBot::InputFile::fromFile(contenidoFilePath, photoMimeType));
-                        bot.getApi().sendMessage(query->message->chat->id, "Alerta enviada el: "+alertaEnv);
-                        foundFiles = true; // Set the flag to true if at least one file is found
-                    }
+        bot.getEvents().onCallbackQuery([this, &bot, &executor](TgBot::CallbackQuery::Ptr query) {
+        // Los botones del historial y la paginación cancelan la consulta anterior del mismo chat
+        const bool historial = query->data == "button4" || query->data == "button5" || query->data == "button6" ||
+                               query->data.rfind("pag:", 0) == 0;
+        executor.submit(query->message->chat->id, historial ? "historial" : query->data,
+                        [this, &bot, query](const BotExecutor::Cancelled& cancelado) {
+            std::string callbackData = query->data;
+            // Check the callback data to identify the button clicked
+            if (callbackData == "button1") {
+            // Handle button 1 click
+                bot.getApi().sendMessage(query->message->chat->id, "El sistema se encuentra enlazado adecuadamente");
+
+            } else if (callbackData == "button2") {
+            // Handle button 2 click
+                string tiempoAct = "El tiempo actual del sistema es: " + tiempoActual();
+                bot.getApi().sendMessage(query->message->chat->id, tiempoAct);
+
+            } else if (callbackData == "button3") {
+            // Handle button 3 click
+                responderConsulta(bot, query->message->chat->id, consultaFija('u', time(nullptr)), 0, cancelado);
+
+            } else if (callbackData == "button4") {
+            // Handle button 4 click
+                responderConsulta(bot, query->message->chat->id, consultaFija('d', time(nullptr)), 0, cancelado);
+
+            } else if (callbackData == "button5") {
+            // Handle button 5 click
+                responderConsulta(bot, query->message->chat->id, consultaFija('m', time(nullptr)), 0, cancelado);
+
+            } else if (callbackData == "button6") {
+            // Handle button 6 click
+                responderConsulta(bot, query->message->chat->id, consultaFija('t', time(nullptr)), 0, cancelado);
+
+            } else if (callbackData.rfind("pag:", 0) == 0) {
+            // Página siguiente del historial
+                const size_t separador = callbackData.rfind(':');
+                AlertQuery consulta;
+                if (AlertQuery::decode(callbackData.substr(4, separador - 4), consulta)) {
+                    const size_t inicio = std::strtoul(callbackData.c_str() + separador + 1, nullptr, 10);
+                    responderConsulta(bot, query->message->chat->id, consulta, inicio, cancelado);
                 }
-            }
-            
-            bot.getApi().sendMessage(query->message->chat->id, "Fin de alertas diarias");
-
-            if (!foundFiles) {
-                bot.getApi().sendMessage(query->message->chat->id, "No se encuentran alertas el día de hoy.");
-            }
-
-
-
-        } else if (callbackData == "button5") {
-        // Handle button 5 click
-            std::string currentMonth = tiempolocal_M(); // Get the current month and year
-            bool foundFiles = false;
-            for (const auto& entry : std::filesystem::directory_iterator(folderFilePath)) {
-                if (std::filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-                    std::string fileName = entry.path().stem().string(); // Get the file name without extension
-                    if (fileName.substr(2, 4) == currentMonth) { // Check if the month part matches the current month
-                        const std::string contenidoFilePath = entry.path().string();
-                        string alertaEnv = alertaDate(contenidoFilePath);
-                        bot.getApi().sendPhoto(query->message->chat->id, TgBot::InputFile::fromFile(contenidoFilePath, photoMimeType));
-                        bot.getApi().sendMessage(query->message->chat->id, "Alerta enviada el: "+alertaEnv);
-                        foundFiles = true; // Set the flag to true if at least one file is found
-                    }
-                }
-            }
-            
-            bot.getApi().sendMessage(query->message->chat->id, "Fin de alertas mensuales");
 
-            if (!foundFiles) {
-                bot.getApi().sendMessage(query->message->chat->id, "No se encuentran alertas este mes.");
-            }
-
-        } else if (callbackData == "button6") {
-        // Handle button 6 click
-            for (const auto& entry : std::filesystem::directory_iterator(folderFilePath)) {
-                if (std::filesystem::is_regular_file(entry) && entry.path().extension() == ".bmp") {
-                    const string contenidoFilePath = entry.path().string();
-                    string alertaEnv = alertaDate(contenidoFilePath);
-                    bot.getApi().sendPhoto(query->message->chat->id, TgBot::InputFile::fromFile(contenidoFilePath, photoMimeType));
-                    bot.getApi().sendMessage(query->message->chat->id, "Alerta enviada el: "+alertaEnv);
+            } else if (callbackData.rfind("original:", 0) == 0) {
+            // Imagen original de una alerta, solo bajo pedido
+                const time_t tiempo = std::strtoll(callbackData.c_str() + strlen("original:"), nullptr, 10);
+                const std::vector<AlertEntry> alertas = alert_journal->range(tiempo, tiempo + 1);
+                if (!alertas.empty() && std::filesystem::is_regular_file(alertas.front().path)) {
+                    const string& original = alertas.front().path;
+                    bot.getApi().sendDocument(query->message->chat->id,
+                                              TgBot::InputFile::fromFile(original, alert_mime_type(original)));
                 } else {
-                bot.getApi().sendMessage(query->message->chat->id, "No hay alertas registradas.");
+                    bot.getApi().sendMessage(query->message->chat->id, "La alerta ya no está disponible.");
                 }
-            }
-            
-             bot.getApi().sendMessage(query->message->chat->id, "Fin de todas las alertas");
 
-        } else {
-            // Handle other buttons or unknown callback data
-            bot.getApi().sendMessage(query->message->chat->id, "Unknown button clicked!");
-        }
+            } else {
+                // Handle other buttons or unknown callback data
+                bot.getApi().sendMessage(query->message->chat->id, "Unknown button clicked!");
+            }
+        });
     });
 
     signal(SIGINT, [](int s) {
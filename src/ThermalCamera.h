@@ -23,9 +23,25 @@ limitations under the License.
 #include <SDL2/SDL_ttf.h>
 #include <MLX90640_API.h>
 #include "constants.h"
+#include "TextCache.h"
+#include "Rasterizer.h"
+#include "AlertSnapshotWorker.h"
+#include "AlertDispatcher.h"
+#include "AlertPolicy.h"
+#include "BuzzerService.h"
+#include "AlertJournal.h"
+#include "AlertStore.h"
+#include "BotExecutor.h"
+#include "LiveMeasurement.h"
+#include "LiveSnapshot.h"
+#include "FrameRing.h"
+#include "Recorder.h"
+#include "TimeSeries.h"
+#include "EpisodeStats.h"
+#include "TemperatureQuantiles.h"
+#include "StreamServer.h"
 #include <chrono>
 #include <iostream>
-#include <pigpio.h>
 #include <unistd.h>
 #include <csignal>
 #include <cstdio>
@@ -38,12 +54,14 @@ using namespace std;
 class ThermalCamera {
 
 public:
-    ThermalCamera();
+    explicit ThermalCamera(bool headless = false);
     
     virtual ~ThermalCamera();
 
     void init_sdl();
 
+    void init_layout(int width, int height);
+
     void init_sensor();
 
     void handle_events();
@@ -58,17 +76,26 @@ public:
     
     void runbot();
     
-    string tiempoActual() const;
-    
-    string tiempolocal_H() const;
-    
-    string tiempolocal_M() const;
-    
-    string getLatestFile(const string& folderPath) const;
+    string tiempoActual(time_t currentTime = time(nullptr)) const;
     
     string alertaDate(const string& filePath) const;
 
     bool running() { return is_running; }
+
+    bool is_headless() const { return headless; }
+
+    // Timing of the last sensor read, used to phase-lock the frame pacer.
+    std::chrono::steady_clock::time_point last_read_start() const { return frame_read_start; }
+
+    std::chrono::steady_clock::time_point last_data_ready() const { return frame_data_ready; }
+
+    bool last_read_waited() const { return frame_read_waited; }
+
+    // Latest measurement, safe to call from any thread. False before the first frame.
+    bool latest_measurement(Measurement &measurement) const { return live_measurement.read(measurement); }
+
+    // Measurement history, safe to query from any thread.
+    const TimeSeriesStore &measurement_history() const { return history; }
     
 
 
@@ -80,9 +107,12 @@ private:
     SDL_Texture *texture;
     SDL_Texture *texture_r;
     SDL_Texture *slider;
+    SDL_Texture *overlay_layer;
     std::vector<SDL_Texture*> animation;
     TTF_Font *font32;
     TTF_Font *font64;
+    // Persistent label textures and glyph atlas used by render_text().
+    mutable TextCache text_cache;
     
     mutable std::chrono::steady_clock::time_point last_screenshot_time; //#########
     
@@ -97,10 +127,48 @@ private:
     const float EMISSIVITY = 0.99;
     // Moving average parameter
     const float BETA = 0.90;
+    // Output size used for alert images when running without a display
+    const int HEADLESS_WIDTH = 480;
+    const int HEADLESS_HEIGHT = 800;
+    // Skip SDL_RenderPresent() when neither the sensor image nor the overlay changed
+    const bool SKIP_UNCHANGED_PRESENT = true;
     // Screen rotation
     const int rotation = 0;
+    // Alerts per page of a history reply, the maximum size of a Telegram media group
+    static const size_t ALERTAS_POR_PAGINA = 10;
+    // Threads answering bot commands
+    static const size_t BOT_WORKERS = 4;
+    // Alert rate limit per chat
+    static constexpr double ALERT_BURST = 6;
+    static constexpr std::chrono::seconds ALERT_REFILL = std::chrono::seconds(30);
+    // Folder where alert images are stored
+    const std::string ALERT_FOLDER = "/home/electronica/Pictures";
+    // Budget of the alert image store, the oldest alerts are evicted beyond it
+    const uint64_t ALERT_STORE_MAX_BYTES = 512ull * 1024 * 1024;
+    const std::chrono::hours ALERT_STORE_MAX_AGE = std::chrono::hours(24 * 90);
+    // Continuous recording of the raw sensor frames, the oldest files are deleted beyond the budget
+    const bool RECORDING_ENABLED = true;
+    const std::string RECORDING_FOLDER = "/home/electronica/Recordings";
+    const uint64_t RECORDING_MAX_BYTES = 4ull * 1024 * 1024 * 1024;
+    // Per frame measurement history: raw frames for 6 hours, 1 s points for 2 days, 1 min points for 90 days
+    const std::string HISTORY_PATH = "/home/electronica/thermalcam.history";
+    static const size_t HISTORY_RAW_FRAMES = 6 * 3600 * FPS;
+    static const size_t HISTORY_SECONDS = 2 * 86400;
+    static const size_t HISTORY_MINUTES = 90 * 1440;
+    // History points read per /tendencia window
+    static const size_t PUNTOS_TENDENCIA = 3600;
+    // Daily and monthly statistics of the measured people, for /resumen
+    const std::string STATS_PATH = "/home/electronica/thermalcam.stats";
+    // Live stream for remote viewers (MJPEG and WebSocket), see StreamServer.h. Only reachable from the Pi itself
+    // unless THERMALCAM_STREAM_BIND gives another address, which also needs THERMALCAM_STREAM_TOKEN.
+    const bool STREAM_ENABLED = true;
+    const std::string STREAM_BIND_ADDRESS = "127.0.0.1";
+    const uint16_t STREAM_PORT = 8080;
     // Font path
     const std::string FONT_PATH = "/usr/share/fonts/truetype/piboto/Piboto-Regular.ttf";
+    // Frames kept before and after an alert. The alert waits for the post-roll before it is rendered and sent.
+    static const size_t PRE_ROLL_FRAMES = 8 * FPS;
+    static const size_t POST_ROLL_FRAMES = 2 * FPS;
     // Measure timer
     const float TIMER_THRESHOLD_SECONDS = .6f;
     const size_t TIMER_THRESHOLD_FRAMES = static_cast<int>(round(TIMER_THRESHOLD_SECONDS * FPS));
@@ -118,9 +186,12 @@ private:
     float mlx90640To[768];
     // Buffer for storing pixel color values to visualize sensor output.
     uint32_t pixels[768];
+    // Pixel values of the last presented frame, to detect an unchanged sensor image.
+    uint32_t pixels_presented[768];
 
     // === Variables ===
     std::string resource_path;
+    const bool headless;
     bool is_running;
     bool is_measuring;
     bool is_measuring_lpf;
@@ -132,6 +203,9 @@ private:
     int offset_top;
     int aspect_scale;
     size_t frame_no;
+    std::chrono::steady_clock::time_point frame_read_start;
+    std::chrono::steady_clock::time_point frame_data_ready;
+    bool frame_read_waited;
     SDL_Rect rect_preserve_aspect;
     SDL_Rect rect_fullscreen;
     bool preserve_aspect = true;
@@ -141,6 +215,61 @@ private:
     float mean_temp_lpf;
     std::string message;
     int animation_frame_nr;
+    std::string temp_label;
+    // Published at the end of every update() for the bot and worker threads, which must not read the members
+    // above while the camera loop changes them
+    LiveMeasurement live_measurement;
+    // Image of the latest frame for /snapshot, encoded once per frame
+    LiveSnapshot live_snapshot{live_measurement, MIN_COLORMAP_RANGE, MAX_COLORMAP_RANGE};
+    // Last frames of the loop, for the alert clips
+    FrameRing frame_ring{PRE_ROLL_FRAMES + POST_ROLL_FRAMES + 1};
+    // Alert waiting for its post-roll frames
+    std::unique_ptr<AlertSnapshot> pending_snapshot;
+    // Drives the buzzer, GPIO is initialised once
+    std::unique_ptr<BuzzerService> buzzer;
+    // Coalesces alerts per measurement episode and rate limits each chat: a burst of ALERT_BURST messages,
+    // then one every ALERT_REFILL.
+    AlertPolicy alert_policy{ALERT_BURST, ALERT_REFILL};
+    // Index of the stored alerts, answers the bot queries without scanning ALERT_FOLDER
+    std::unique_ptr<AlertJournal> alert_journal;
+    // Places alert images in date directories and keeps them within budget
+    std::unique_ptr<AlertStore> alert_store;
+    // Delivers alerts to the Telegram chats
+    std::unique_ptr<AlertDispatcher> alert_dispatcher;
+    // History of the per frame values, for reports and dashboards
+    TimeSeriesStore history{HISTORY_PATH, HISTORY_RAW_FRAMES, HISTORY_SECONDS, HISTORY_MINUTES};
+    // Per day and per month aggregates of the measurement episodes
+    EpisodeStats episode_stats{STATS_PATH};
+    // p50/p95/p99 of the measured temperatures over sliding windows, for /percentiles and the metrics
+    TemperatureQuantiles temperature_quantiles;
+    // Serves the published frames to remote viewers
+    std::unique_ptr<StreamServer> stream_server;
+    // Writes the raw frames to RECORDING_FOLDER off the camera thread
+    std::unique_ptr<Recorder> recorder;
+    // Renders and writes alert images off the camera thread
+    std::unique_ptr<AlertSnapshotWorker> snapshot_worker;
+
+    // === Compositor ===
+    // Inputs of the overlay layer; the layer is redrawn only when these change.
+    struct OverlayState {
+        bool is_measuring;
+        std::string message;
+        std::string label;
+        bool label_dark;
+        int marker_x;
+        int animation_frame_nr;
+
+        bool operator==(const OverlayState &other) const {
+            return is_measuring == other.is_measuring && message == other.message && label == other.label &&
+                   label_dark == other.label_dark && marker_x == other.marker_x &&
+                   animation_frame_nr == other.animation_frame_nr;
+        }
+    };
+    OverlayState overlay;
+    bool overlay_valid;
+    size_t presents_done;
+    size_t presents_skipped;
+    std::chrono::steady_clock::time_point presents_report_time;
     
 
 
@@ -155,11 +284,52 @@ private:
 
     void render_slider() const;
 
+    int slider_marker_x() const;
+
+    // Marker position on the slider for a given reading
+    int slider_marker_x(float temperature) const;
+
     void render_temp_labels() const;
 
-    void render_animation();
+    void render_animation() const;
+
+    void advance_animation();
+
+    void render_overlay() const;
+
+    OverlayState overlay_state() const;
+
+    void report_presents();
+
+    void update_alert();
+
+    void publish_measurement();
+
+    void send_alert(const string& imagePath, std::time_t time) const;
+
+    void send_summary(const EpisodeSummary& summary) const;
+
+    string leyendaAlerta(const AlertEntry& alerta) const;
+
+    string textoMedicion(const Measurement& medicion) const;
+
+    string textoResumen(const string& titulo, const StatsBucket& estadisticas) const;
+
+    string textoTendencia(const string& titulo, int64_t desde_ms, int64_t ahora_ms) const;
+
+    void enviarAlertas(TgBot::Bot& bot, std::int64_t chatId, const std::vector<AlertEntry>& alertas) const;
+
+    void responderConsulta(TgBot::Bot& bot, std::int64_t chatId, const AlertQuery& consulta, size_t inicio,
+                           const BotExecutor::Cancelled& cancelado) const;
+
+    void screenshot();
+
+    void finish_screenshot();
+
+    string mensajeTemperatura(float temperatura) const;
+
+    bool wait_data_ready() const;
 
-    void screenshot() const;
     
     
 };
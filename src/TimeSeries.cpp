@@ -0,0 +1,275 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <SDL2/SDL.h>
+#include "TimeSeries.h"
+#include "constants.h"
+
+// The columns are shared with reader threads through the mapping, so every cell is stored and loaded as a relaxed
+// atomic (no data race, and no torn 64 bit times on 32 bit ARM); the row counts order them.
+template<typename T>
+static inline void store_cell(T *cell, T value) {
+    static_assert(__atomic_always_lock_free(sizeof(T), 0), "Cells must be lock free atomics");
+    __atomic_store(cell, &value, __ATOMIC_RELAXED);
+}
+
+template<typename T>
+static inline T load_cell(const T *cell) {
+    T value;
+    __atomic_load(cell, &value, __ATOMIC_RELAXED);
+    return value;
+}
+
+TimeSeriesStore::TimeSeriesStore(const std::string &_path, size_t raw_capacity, size_t second_capacity,
+                                 size_t minute_capacity)
+        : path(_path), capacities{raw_capacity, second_capacity, minute_capacity}, fd(-1), mapping(nullptr),
+          mapping_size(0), tiers(), accumulators(), last_time_ms(INT64_MIN) {
+}
+
+TimeSeriesStore::~TimeSeriesStore() {
+    if (mapping != nullptr) {
+        // Buckets in progress are lost, like the frames of a crash
+        munmap(mapping, mapping_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static size_t round_to_page(size_t size, size_t page) {
+    return (size + page - 1) / page * page;
+}
+
+size_t TimeSeriesStore::layout(uint8_t *base) {
+    static const int64_t INTERVALS_MS[N_TIERS] = {0, 1000, 60000};
+    size_t offset = PAGE;
+    for (int t = 0; t < N_TIERS; t++) {
+        Tier &tier = tiers[t];
+        const uint64_t capacity = capacities[t];
+        const bool aggregated = t != TIER_RAW;
+        tier.capacity = capacity;
+        tier.interval_ms = INTERVALS_MS[t];
+        // Every column starts on its own page
+        auto column = [&](size_t element_size) {
+            uint8_t *start = base != nullptr ? base + offset : nullptr;
+            offset += round_to_page(capacity * element_size, PAGE);
+            return start;
+        };
+        tier.time = reinterpret_cast<int64_t *>(column(sizeof(int64_t)));
+        tier.frames = aggregated ? reinterpret_cast<uint32_t *>(column(sizeof(uint32_t))) : nullptr;
+        for (int s = 0; s < N_SERIES; s++) {
+            tier.mean[s] = reinterpret_cast<float *>(column(sizeof(float)));
+            tier.min[s] = aggregated ? reinterpret_cast<float *>(column(sizeof(float))) : nullptr;
+            tier.max[s] = aggregated ? reinterpret_cast<float *>(column(sizeof(float))) : nullptr;
+        }
+    }
+    return offset;
+}
+
+bool TimeSeriesStore::open() {
+    mapping_size = layout(nullptr);
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info = {};
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open measurement history %s", path.c_str());
+        return false;
+    }
+    bool fresh = static_cast<size_t>(info.st_size) != mapping_size;
+    if (fresh) {
+        // Reserve the blocks now: a write to a hole of a full SD card would kill the camera with SIGBUS
+        if (ftruncate(fd, 0) != 0 || posix_fallocate(fd, 0, static_cast<off_t>(mapping_size)) != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to allocate measurement history %s", path.c_str());
+            return false;
+        }
+    }
+    // Prefault, so append() does not wait for pages to be read in
+    mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to map measurement history %s", path.c_str());
+        return false;
+    }
+    auto *header = static_cast<FileHeader *>(mapping);
+    auto *base = static_cast<uint8_t *>(mapping);
+    layout(base);
+    fresh = fresh || header->magic != MAGIC || header->version != VERSION || header->n_series != N_SERIES;
+    for (int t = 0; t < N_TIERS && !fresh; t++) {
+        fresh = header->tiers[t].capacity != tiers[t].capacity ||
+                header->tiers[t].offset != static_cast<uint64_t>(reinterpret_cast<uint8_t *>(tiers[t].time) - base);
+    }
+    if (fresh) {
+        memset(mapping, 0, PAGE);
+        header->version = VERSION;
+        header->n_series = N_SERIES;
+        for (int t = 0; t < N_TIERS; t++) {
+            header->tiers[t].capacity = tiers[t].capacity;
+            header->tiers[t].offset = reinterpret_cast<uint8_t *>(tiers[t].time) - base;
+            new(&header->tiers[t].head) std::atomic<uint64_t>(0);
+        }
+        header->magic = MAGIC;
+    }
+    for (int t = 0; t < N_TIERS; t++) {
+        tiers[t].head = &header->tiers[t].head;
+        accumulators[t].frames = 0;
+    }
+    const uint64_t raw_head = tiers[TIER_RAW].head->load();
+    last_time_ms = raw_head > 0 ? load_cell(&tiers[TIER_RAW].time[(raw_head - 1) % tiers[TIER_RAW].capacity]) : INT64_MIN;
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Measurement history: %zu frames, %zu s, %zu min stored",
+                static_cast<size_t>(tiers[TIER_RAW].head->load()), static_cast<size_t>(tiers[TIER_SECOND].head->load()),
+                static_cast<size_t>(tiers[TIER_MINUTE].head->load()));
+    return true;
+}
+
+void TimeSeriesStore::append(int64_t time_ms, const float *values) {
+    if (mapping == nullptr) {
+        return;
+    }
+    // The wall clock steps back when NTP syncs: hold the time until it catches up, query() relies on the rows
+    // being in time order
+    time_ms = std::max(time_ms, last_time_ms);
+    last_time_ms = time_ms;
+    Tier &raw = tiers[TIER_RAW];
+    const uint64_t head = raw.head->load(std::memory_order_relaxed);
+    const uint64_t row = head % raw.capacity;
+    // Readers that see the new cells also see the previous head, which marks the row as being overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    store_cell(&raw.time[row], time_ms);
+    for (int s = 0; s < N_SERIES; s++) {
+        store_cell(&raw.mean[s][row], values[s]);
+    }
+    // Publish the row
+    raw.head->store(head + 1, std::memory_order_release);
+    accumulate(TIER_SECOND, time_ms, values);
+    accumulate(TIER_MINUTE, time_ms, values);
+}
+
+void TimeSeriesStore::accumulate(TimeSeriesTier tier, int64_t time_ms, const float *values) {
+    Accumulator &accumulator = accumulators[tier];
+    const int64_t interval_ms = tiers[tier].interval_ms;
+    const int64_t bucket_ms = time_ms - ((time_ms % interval_ms) + interval_ms) % interval_ms;
+    if (accumulator.frames > 0 && bucket_ms != accumulator.bucket_ms) {
+        flush(tier);
+    }
+    if (accumulator.frames == 0) {
+        accumulator.bucket_ms = bucket_ms;
+        for (int s = 0; s < N_SERIES; s++) {
+            accumulator.count[s] = 0;
+            accumulator.sum[s] = 0;
+            accumulator.min[s] = INFINITY;
+            accumulator.max[s] = -INFINITY;
+        }
+    }
+    accumulator.frames++;
+    for (int s = 0; s < N_SERIES; s++) {
+        if (std::isnan(values[s])) {
+            continue;
+        }
+        accumulator.count[s]++;
+        accumulator.sum[s] += values[s];
+        accumulator.min[s] = std::fmin(accumulator.min[s], values[s]);
+        accumulator.max[s] = std::fmax(accumulator.max[s], values[s]);
+    }
+}
+
+void TimeSeriesStore::flush(TimeSeriesTier tier) {
+    Accumulator &accumulator = accumulators[tier];
+    Tier &target = tiers[tier];
+    const uint64_t head = target.head->load(std::memory_order_relaxed);
+    const uint64_t row = head % target.capacity;
+    std::atomic_thread_fence(std::memory_order_release);
+    store_cell(&target.time[row], accumulator.bucket_ms);
+    store_cell(&target.frames[row], accumulator.frames);
+    for (int s = 0; s < N_SERIES; s++) {
+        const bool measured = accumulator.count[s] > 0;
+        const float mean = measured ? static_cast<float>(accumulator.sum[s] / accumulator.count[s]) : NAN;
+        store_cell(&target.mean[s][row], mean);
+        store_cell(&target.min[s][row], measured ? accumulator.min[s] : NAN);
+        store_cell(&target.max[s][row], measured ? accumulator.max[s] : NAN);
+    }
+    target.head->store(head + 1, std::memory_order_release);
+    accumulator.frames = 0;
+}
+
+size_t TimeSeriesStore::query(TimeSeriesTier tier, int64_t from_ms, int64_t to_ms,
+                              std::vector<TimeSeriesPoint> &points, uint32_t series) const {
+    points.clear();
+    if (mapping == nullptr) {
+        return 0;
+    }
+    const Tier &source = tiers[tier];
+    const uint64_t capacity = source.capacity;
+    const uint64_t head = source.head->load(std::memory_order_acquire);
+    const uint64_t oldest = head > capacity ? head - capacity : 0;
+    // Rows are in time order, binary search the first one at or after from_ms
+    uint64_t low = oldest, high = head;
+    while (low < high) {
+        const uint64_t middle = low + (high - low) / 2;
+        if (load_cell(&source.time[middle % capacity]) < from_ms) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    const uint64_t first = low;
+    for (uint64_t i = first; i < head; i++) {
+        const uint64_t row = i % capacity;
+        TimeSeriesPoint point;
+        point.time_ms = load_cell(&source.time[row]);
+        if (point.time_ms >= to_ms) {
+            break;
+        }
+        point.frames = source.frames != nullptr ? load_cell(&source.frames[row]) : 1;
+        for (int s = 0; s < N_SERIES; s++) {
+            if ((series & (1u << s)) == 0) {
+                point.mean[s] = point.min[s] = point.max[s] = NAN;
+                continue;
+            }
+            point.mean[s] = load_cell(&source.mean[s][row]);
+            point.min[s] = source.min[s] != nullptr ? load_cell(&source.min[s][row]) : point.mean[s];
+            point.max[s] = source.max[s] != nullptr ? load_cell(&source.max[s][row]) : point.mean[s];
+        }
+        points.push_back(point);
+    }
+    // The writer may have overwritten the oldest rows meanwhile (and may be writing the slot after the last
+    // published row): drop them.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t head_after = source.head->load(std::memory_order_relaxed);
+    const uint64_t valid_from = head_after >= capacity ? head_after - capacity + 1 : 0;
+    if (valid_from > first) {
+        points.erase(points.begin(), points.begin() + static_cast<long>(std::min<uint64_t>(valid_from - first,
+                                                                                         points.size())));
+    }
+    return points.size();
+}
+
+TimeSeriesTier TimeSeriesStore::tier_for(int64_t from_ms, int64_t to_ms, size_t max_points) {
+    const int64_t span_ms = to_ms - from_ms;
+    if (span_ms / std::max<int64_t>(1, FRAME_TIME_MICROS / 1000) <= static_cast<int64_t>(max_points)) {
+        return TIER_RAW;
+    }
+    if (span_ms / 1000 <= static_cast<int64_t>(max_points)) {
+        return TIER_SECOND;
+    }
+    return TIER_MINUTE;
+}
@@ -0,0 +1,148 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_TIMESERIES_H
+#define THERMALCAM_TIMESERIES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Values recorded for every frame. A value that was not measured is NAN.
+enum TimeSeriesSeries {
+    SERIES_MEAN_TEMP,
+    SERIES_MEAN_TEMP_LPF,
+    // Pixels in the skin temperature range
+    SERIES_SAMPLES,
+    // Estimated environment temperature (eTa)
+    SERIES_AMBIENT,
+    // Sensor die temperature (Ta)
+    SERIES_SENSOR_TA,
+    N_SERIES
+};
+
+enum TimeSeriesTier {
+    TIER_RAW,
+    TIER_SECOND,
+    TIER_MINUTE,
+    N_TIERS
+};
+
+struct TimeSeriesPoint {
+    // Frame time, or start of the second / minute
+    int64_t time_ms;
+    // Frames aggregated in the point
+    uint32_t frames;
+    // Mean, min and max of the measured values (all three the same on the raw tier), NAN if none was measured
+    float mean[N_SERIES];
+    float min[N_SERIES];
+    float max[N_SERIES];
+};
+
+// Per frame measurement history in a memory mapped file, with a raw tier and 1 second and 1 minute tiers (mean,
+// min, max) maintained incrementally as frames arrive. Each tier is a ring stored by column, every column in its
+// own pages, so a query reads the time column by binary search and then only the rows and columns it asks for.
+//
+// append() is called by the camera thread and only writes to the mapping (no locks, no system calls; the file is
+// preallocated and prefaulted, the kernel writes the pages back). Readers on other threads load the published
+// row count of a tier and discard rows the writer may have overwritten while they were being read. Cells are
+// written and read as relaxed atomics, ordered by fences around the row counts like a seqlock.
+class TimeSeriesStore {
+
+public:
+    static const uint32_t ALL_SERIES = (1u << N_SERIES) - 1;
+
+    TimeSeriesStore(const std::string &path, size_t raw_capacity, size_t second_capacity, size_t minute_capacity);
+
+    virtual ~TimeSeriesStore();
+
+    // Map the file, creating it (or recreating it if the layout changed).
+    bool open();
+
+    // Camera thread only. A time earlier than the last row's is recorded as the last row's.
+    void append(int64_t time_ms, const float *values);
+
+    // Points with from_ms <= time < to_ms, oldest first. Only the series in the mask are filled in.
+    size_t query(TimeSeriesTier tier, int64_t from_ms, int64_t to_ms, std::vector<TimeSeriesPoint> &points,
+                 uint32_t series = ALL_SERIES) const;
+
+    // Finest tier that covers the range in at most max_points points.
+    static TimeSeriesTier tier_for(int64_t from_ms, int64_t to_ms, size_t max_points);
+
+private:
+    static const uint32_t MAGIC = 0x53544354; // "TCTS"
+    static const uint16_t VERSION = 1;
+    static const size_t PAGE = 4096;
+
+    // Start of the file, one page
+    struct TierHeader {
+        uint64_t capacity;
+        uint64_t offset;
+        // Rows written since the file was created; row i is at i % capacity
+        std::atomic<uint64_t> head;
+    };
+    struct FileHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t n_series;
+        TierHeader tiers[N_TIERS];
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "The row counts are shared through the mapping");
+
+    struct Tier {
+        uint64_t capacity;
+        int64_t interval_ms;
+        std::atomic<uint64_t> *head;
+        int64_t *time;
+        // Aggregated tiers only
+        uint32_t *frames;
+        float *mean[N_SERIES];
+        float *min[N_SERIES];
+        float *max[N_SERIES];
+    };
+
+    // Bucket of an aggregated tier being filled
+    struct Accumulator {
+        int64_t bucket_ms;
+        uint32_t frames;
+        uint32_t count[N_SERIES];
+        double sum[N_SERIES];
+        float min[N_SERIES];
+        float max[N_SERIES];
+    };
+
+    const std::string path;
+    const size_t capacities[N_TIERS];
+    int fd;
+    void *mapping;
+    size_t mapping_size;
+    Tier tiers[N_TIERS];
+    Accumulator accumulators[N_TIERS];
+    // Time of the last raw row
+    int64_t last_time_ms;
+
+    // Lay out the tiers; returns the file size
+    size_t layout(uint8_t *base);
+
+    void flush(TimeSeriesTier tier);
+
+    void accumulate(TimeSeriesTier tier, int64_t time_ms, const float *values);
+};
+
+
+#endif //THERMALCAM_TIMESERIES_H
@@ -25,7 +25,7 @@ struct ColorMap {
     std::vector<uint8_t> b;
 };
 
-ColorMap get_colormap_magma() {
+inline ColorMap get_colormap_magma() {
     std::vector<uint8_t> r = {
             0,   0,   0,   1,   1,   1,   2,   2,   1,   3,   0,   2,   3,
             4,   5,   6,   8,   9,  11,  12,  15,  17,  19,  20,  22,  25,
@@ -99,7 +99,7 @@ ColorMap get_colormap_magma() {
     return cm;
 }
 
-ColorMap get_colormap_jet() {
+inline ColorMap get_colormap_jet() {
     std::vector<uint8_t> r = {
             0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
             0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -27,8 +27,8 @@ limitations under the License.
 #define FRAME_TIME_MICROS (1000000/FPS)
 // Despite the framerate being ostensibly FPS hz
 // The frame is often not ready in time
-// This offset is added to the FRAME_TIME_MICROS
-// to account for this.
+// The frame pacer aims to wake up this long before
+// the sensor flags new data, to account for this.
 #define OFFSET_MICROS 200
 
 #endif //THERMALCAM_CONSTANTS_H
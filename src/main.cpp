@@ -18,17 +18,25 @@ limitations under the License.
 #include <thread>
 #include "constants.h"
 #include "ThermalCamera.h"
-#include <pigpio.h>
+#include "FramePacer.h"
+#include "Metrics.h"
 #include <unistd.h>
 #include <tgbot/tgbot.h>
 #include <thread>
 
 
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Headless mode (no display): --headless or THERMALCAM_HEADLESS=1
+    bool headless = getenv("THERMALCAM_HEADLESS") != nullptr && std::string(getenv("THERMALCAM_HEADLESS")) == "1";
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--headless") {
+            headless = true;
+        }
+    }
     
-    ThermalCamera thermal_camera;
-    auto frame_time = std::chrono::microseconds(FRAME_TIME_MICROS + OFFSET_MICROS);
+    ThermalCamera thermal_camera(headless);
+    FramePacer pacer(std::chrono::microseconds(FRAME_TIME_MICROS), std::chrono::microseconds(OFFSET_MICROS));
  //Thread del bot 
    
     std::thread botThread([&thermal_camera]() {
@@ -37,16 +45,17 @@ int main() {
 
 
     while (thermal_camera.running()) {
-        auto start = std::chrono::system_clock::now();
         thermal_camera.handle_events();
         thermal_camera.update();
+        pacer.frame_read(thermal_camera.last_read_start(), thermal_camera.last_data_ready(),
+                         thermal_camera.last_read_waited());
         thermal_camera.render();
     
  //     thermal_camera.soundBuzzer();
 
-        auto end = std::chrono::system_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-        std::this_thread::sleep_for(std::chrono::microseconds(frame_time - elapsed));
+        pacer.report();
+        Metrics::instance().export_if_due();
+        pacer.wait();
 
     }
     
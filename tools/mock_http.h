@@ -0,0 +1,252 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_MOCK_HTTP_H
+#define THERMALCAM_MOCK_HTTP_H
+
+// Minimal HTTP/1.1 over POSIX sockets for the offline test tools. Enough for tgbot-cpp's clients and for the
+// load generator, not a general purpose implementation.
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mock_http {
+
+struct Request {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::map<std::string, std::string> headers;
+    std::string body;
+    bool keep_alive = true;
+};
+
+inline std::string lower(std::string s) {
+    for (char &c : s) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return s;
+}
+
+// Read one request from a connection. buffer keeps bytes that belong to the next request.
+inline bool read_request(int fd, std::string &buffer, Request &request) {
+    size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        char chunk[16384];
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    request = Request();
+    const std::string head = buffer.substr(0, header_end);
+    size_t line_end = head.find("\r\n");
+    const std::string request_line = head.substr(0, line_end);
+    const size_t sp1 = request_line.find(' ');
+    const size_t sp2 = request_line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) {
+        return false;
+    }
+    request.method = request_line.substr(0, sp1);
+    const std::string target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    const size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    request.query = question == std::string::npos ? "" : target.substr(question + 1);
+    request.keep_alive = request_line.substr(sp2 + 1) == "HTTP/1.1";
+    while (line_end != std::string::npos && line_end < head.size()) {
+        const size_t next = head.find("\r\n", line_end + 2);
+        const std::string line = head.substr(line_end + 2, next == std::string::npos ? std::string::npos
+                                                                                       : next - line_end - 2);
+        const size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            request.headers[lower(line.substr(0, colon))] = value;
+        }
+        line_end = next;
+    }
+    if (request.headers.count("connection")) {
+        const std::string connection = lower(request.headers["connection"]);
+        request.keep_alive = connection == "close" ? false : connection == "keep-alive" || request.keep_alive;
+    }
+    const size_t length = request.headers.count("content-length") ?
+                          std::strtoul(request.headers["content-length"].c_str(), nullptr, 10) : 0;
+    buffer.erase(0, header_end + 4);
+    while (buffer.size() < length) {
+        char chunk[16384];
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    request.body = buffer.substr(0, length);
+    buffer.erase(0, length);
+    return true;
+}
+
+inline bool send_all(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool write_response(int fd, int status, const std::string &body, bool keep_alive) {
+    const char *reason = status == 200 ? "OK" : status == 404 ? "Not Found" : status == 429 ? "Too Many Requests"
+                                                                                          : "Error";
+    return send_all(fd, "HTTP/1.1 " + std::to_string(status) + " " + reason +
+                        "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+                        (keep_alive ? "\r\nConnection: keep-alive" : "\r\nConnection: close") + "\r\n\r\n" + body);
+}
+
+inline std::string url_decode(const std::string &s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size()) {
+            out += static_cast<char>(std::strtol(s.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+inline std::string url_encode(const std::string &s) {
+    static const char *hex = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : s) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += hex[c >> 4u];
+            out += hex[c & 15u];
+        }
+    }
+    return out;
+}
+
+// Parameters of a request: query string, urlencoded body or multipart/form-data (files are kept as their size).
+inline std::map<std::string, std::string> parameters(const Request &request) {
+    std::map<std::string, std::string> params;
+    auto parse_urlencoded = [&params](const std::string &text) {
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('&', start);
+            end = end == std::string::npos ? text.size() : end;
+            const std::string pair = text.substr(start, end - start);
+            const size_t eq = pair.find('=');
+            params[url_decode(pair.substr(0, eq))] = eq == std::string::npos ? "" : url_decode(pair.substr(eq + 1));
+            start = end + 1;
+        }
+    };
+    parse_urlencoded(request.query);
+    auto content_type = request.headers.find("content-type");
+    const std::string type = content_type == request.headers.end() ? "" : content_type->second;
+    const size_t boundary_pos = type.find("boundary=");
+    if (type.find("multipart/form-data") != std::string::npos && boundary_pos != std::string::npos) {
+        std::string boundary = type.substr(boundary_pos + 9);
+        if (!boundary.empty() && boundary.front() == '"') {
+            boundary = boundary.substr(1, boundary.find('"', 1) - 1);
+        }
+        const std::string delimiter = "--" + boundary;
+        size_t pos = request.body.find(delimiter);
+        while (pos != std::string::npos) {
+            const size_t part_start = pos + delimiter.size() + 2;
+            const size_t next = request.body.find(delimiter, part_start);
+            if (next == std::string::npos) {
+                break;
+            }
+            const size_t head_end = request.body.find("\r\n\r\n", part_start);
+            if (head_end != std::string::npos && head_end < next) {
+                const std::string head = request.body.substr(part_start, head_end - part_start);
+                const size_t name_pos = head.find("name=\"");
+                if (name_pos != std::string::npos) {
+                    const std::string name = head.substr(name_pos + 6, head.find('"', name_pos + 6) - name_pos - 6);
+                    const std::string value = request.body.substr(head_end + 4, next - head_end - 6);
+                    params[name] = head.find("filename=") != std::string::npos ?
+                                   "<file " + std::to_string(value.size()) + " bytes>" : value;
+                }
+            }
+            pos = next;
+        }
+    } else {
+        parse_urlencoded(request.body);
+    }
+    return params;
+}
+
+// Blocking request on a new connection. Returns the HTTP status, or -1 on a connection error.
+inline int request(const std::string &host, const std::string &port, const std::string &method,
+                   const std::string &target, const std::string &body, std::string &response_body) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo *a = addresses; a != nullptr && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return -1;
+    }
+    const std::string message = method + " " + target + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n" +
+                                "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: " +
+                                std::to_string(body.size()) + "\r\n\r\n" + body;
+    std::string raw;
+    if (send_all(fd, message)) {
+        char chunk[16384];
+        ssize_t n;
+        while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+            raw.append(chunk, static_cast<size_t>(n));
+        }
+    }
+    close(fd);
+    const size_t head_end = raw.find("\r\n\r\n");
+    if (raw.compare(0, 5, "HTTP/") != 0 || head_end == std::string::npos) {
+        return -1;
+    }
+    response_body = raw.substr(head_end + 4);
+    return std::atoi(raw.c_str() + raw.find(' ') + 1);
+}
+
+}
+
+
+#endif //THERMALCAM_MOCK_HTTP_H
@@ -0,0 +1,405 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+// Exports continuous recordings (.tcr) to a columnar file for off-device analysis: the metadata of every frame
+// and its 768 temperatures, recomputed from the raw words with MLX90640_CalculateTo() and the EEPROM stored in
+// each recording. Folders are searched for recordings, so a day is exported with its date folder.
+//
+//   recording_export [-j threads] [--no-pixels] -o out.tcol (file.tcr | folder)...
+//
+// Columnar file (.tcol), host byte order (little endian on the Pi and on PCs):
+// - Header, 16 bytes: magic "TCCF", version (u16), column count (u16), 8 reserved bytes.
+// - Row groups, one per GROUP_BLOCKS recording blocks. A row group stores the columns one after the other, each
+//   as rows x values_per_row values of its type, without padding or compression, so a column maps straight
+//   into an array (numpy.frombuffer / numpy.memmap).
+// - Footer, as in Parquet: the columns (name[32], type u8, 3 reserved bytes, values_per_row u32), the row group
+//   count (u64) and the row groups (offset u64, rows u64, first time_ms i64), a metadata text of "key=value"
+//   lines (u32 size, then the text), the size of all of the above (u64) and the magic again.
+//
+// Columns: frame_no, time_ms, file (index of the source in the metadata), subpage, sensor_ta, ambient,
+// mean_temp and samples (as computed by ThermalCamera::update(), without the body temperature offset) and
+// temperatures (768 values per frame, sensor order: 24 rows of 32 pixels). A recording starts with the pixels of
+// one subpage unknown, those are NaN in its first frame.
+//
+// Conversion runs on all cores: row groups are converted in parallel and written in order. Every row group
+// first converts the last frame of the block before it, which holds the pixels of the other subpage.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <MLX90640_API.h>
+#include "Recording.h"
+
+using namespace std::chrono;
+
+static const uint32_t MAGIC = 0x46434354; // "TCCF"
+static const uint16_t VERSION = 1;
+// Recording blocks per row group (64 frames each)
+static const size_t GROUP_BLOCKS = 16;
+// Row groups converted ahead of the writer, per thread
+static const size_t GROUPS_AHEAD = 2;
+// Same conversion as ThermalCamera::update()
+static const float AMBIENT_OFFSET = 6.0f;
+static const float MIN_MEASURE_RANGE = 15.0f;
+static const float MAX_MEASURE_RANGE = 45.0f;
+
+enum ColumnType : uint8_t {
+    TYPE_UINT8 = 1,
+    TYPE_UINT16 = 2,
+    TYPE_UINT32 = 3,
+    TYPE_UINT64 = 4,
+    TYPE_INT64 = 5,
+    TYPE_FLOAT32 = 6,
+};
+
+enum ColumnId {
+    COLUMN_FRAME_NO,
+    COLUMN_TIME_MS,
+    COLUMN_FILE,
+    COLUMN_SUBPAGE,
+    COLUMN_SENSOR_TA,
+    COLUMN_AMBIENT,
+    COLUMN_MEAN_TEMP,
+    COLUMN_SAMPLES,
+    COLUMN_TEMPERATURES,
+    N_COLUMNS
+};
+
+struct Column {
+    const char *name;
+    ColumnType type;
+    uint32_t values_per_row;
+};
+
+static const Column COLUMNS[N_COLUMNS] = {
+        {"frame_no", TYPE_UINT64, 1},
+        {"time_ms", TYPE_INT64, 1},
+        {"file", TYPE_UINT32, 1},
+        {"subpage", TYPE_UINT8, 1},
+        {"sensor_ta", TYPE_FLOAT32, 1},
+        {"ambient", TYPE_FLOAT32, 1},
+        {"mean_temp", TYPE_FLOAT32, 1},
+        {"samples", TYPE_UINT16, 1},
+        {"temperatures", TYPE_FLOAT32, 768},
+};
+
+struct Source {
+    std::string path;
+    float emissivity;
+    paramsMLX90640 params;
+    // False when the EEPROM lists too many deviating pixels for MLX90640_BadPixelsCorrection()
+    bool correct_pixels;
+    std::vector<RecordingBlockInfo> blocks;
+};
+
+// Blocks [first_block, first_block + blocks) of one source
+struct Unit {
+    size_t source;
+    size_t first_block;
+    size_t blocks;
+};
+
+struct RowGroup {
+    size_t rows = 0;
+    int64_t first_time_ms = 0;
+    std::vector<uint8_t> columns[N_COLUMNS];
+};
+
+template<typename T>
+static void put(std::vector<uint8_t> &column, const T *values, size_t count) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+    column.insert(column.end(), bytes, bytes + count * sizeof(T));
+}
+
+template<typename T>
+static void put(std::vector<uint8_t> &column, T value) {
+    put(column, &value, 1);
+}
+
+static void collect(const std::filesystem::path &path, std::vector<std::string> &paths) {
+    std::error_code error;
+    if (std::filesystem::is_directory(path, error)) {
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(path, error)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".tcr") {
+                paths.push_back(entry.path().string());
+            }
+        }
+    } else {
+        paths.push_back(path.string());
+    }
+}
+
+static bool open_source(const std::string &path, Source &source) {
+    RecordingReader reader;
+    if (!reader.open(path)) {
+        fprintf(stderr, "%s: not a recording\n", path.c_str());
+        return false;
+    }
+    uint16_t eeprom[RECORDING_EEPROM_WORDS];
+    std::copy(reader.eeprom(), reader.eeprom() + RECORDING_EEPROM_WORDS, eeprom);
+    // -7: not an MLX90640 EEPROM. The other errors are about deviating pixels: the lists are full and not
+    // terminated, so the correction would read past them.
+    const int error = MLX90640_ExtractParameters(eeprom, &source.params);
+    if (error == -7) {
+        fprintf(stderr, "%s: invalid EEPROM in the header\n", path.c_str());
+        return false;
+    }
+    if (error != 0) {
+        fprintf(stderr, "%s: EEPROM error %d, exported without bad pixel correction\n", path.c_str(), error);
+    }
+    source.correct_pixels = error == 0;
+    source.path = path;
+    source.emissivity = reader.emissivity();
+    source.blocks = reader.blocks();
+    return true;
+}
+
+static void convert_frame(RecordedFrame &frame, const Source &source, paramsMLX90640 &params, float *temperatures,
+                          float &sensor_ta, float &ambient, float &mean_temp, uint16_t &samples) {
+    sensor_ta = MLX90640_GetTa(frame.words, &params);
+    ambient = sensor_ta - AMBIENT_OFFSET;
+    MLX90640_CalculateTo(frame.words, &params, source.emissivity, ambient, temperatures);
+    if (source.correct_pixels) {
+        MLX90640_BadPixelsCorrection(params.brokenPixels, temperatures, 1, &params);
+        MLX90640_BadPixelsCorrection(params.outlierPixels, temperatures, 1, &params);
+    }
+    float sum = 0.0f;
+    samples = 0;
+    for (int i = 0; i < 768; i++) {
+        if (temperatures[i] > MIN_MEASURE_RANGE && temperatures[i] < MAX_MEASURE_RANGE) {
+            sum += temperatures[i];
+            samples++;
+        }
+    }
+    mean_temp = samples > 0 ? sum / samples : NAN;
+}
+
+static void convert_unit(const Unit &unit, const Source &source, bool pixels, RowGroup &group) {
+    RecordingReader reader;
+    if (!reader.open(source.path)) {
+        return;
+    }
+    // The MLX90640 API takes non-const parameters
+    paramsMLX90640 params = source.params;
+    float temperatures[768];
+    std::fill(temperatures, temperatures + 768, NAN);
+    float sensor_ta, ambient, mean_temp;
+    uint16_t samples;
+    RecordedFrame frame;
+    if (unit.first_block > 0) {
+        // Warm up with the last frame before the group, for the pixels of the other subpage. If that block is
+        // damaged, the other subpage stays NAN until the group's own frames fill it.
+        reader.seek_block(unit.first_block - 1);
+        uint32_t read = 0;
+        while (read < source.blocks[unit.first_block - 1].frames && reader.next(frame)) {
+            read++;
+        }
+        if (read > 0) {
+            convert_frame(frame, source, params, temperatures, sensor_ta, ambient, mean_temp, samples);
+        }
+    }
+    reader.seek_block(unit.first_block);
+    size_t frames = 0;
+    for (size_t b = unit.first_block; b < unit.first_block + unit.blocks; b++) {
+        frames += source.blocks[b].frames;
+    }
+    for (size_t i = 0; i < frames && reader.next(frame); i++) {
+        convert_frame(frame, source, params, temperatures, sensor_ta, ambient, mean_temp, samples);
+        if (group.rows == 0) {
+            group.first_time_ms = frame.time_ms;
+        }
+        put(group.columns[COLUMN_FRAME_NO], frame.frame_no);
+        put(group.columns[COLUMN_TIME_MS], frame.time_ms);
+        put(group.columns[COLUMN_FILE], static_cast<uint32_t>(unit.source));
+        put(group.columns[COLUMN_SUBPAGE], static_cast<uint8_t>(frame.words[833] & 1));
+        put(group.columns[COLUMN_SENSOR_TA], sensor_ta);
+        put(group.columns[COLUMN_AMBIENT], ambient);
+        put(group.columns[COLUMN_MEAN_TEMP], mean_temp);
+        put(group.columns[COLUMN_SAMPLES], samples);
+        if (pixels) {
+            put(group.columns[COLUMN_TEMPERATURES], temperatures, 768);
+        }
+        group.rows++;
+    }
+    if (group.rows < frames) {
+        fprintf(stderr, "%s: damaged block, %zu of %zu frames exported from block %zu\n", source.path.c_str(),
+                group.rows, frames, unit.first_block);
+    }
+}
+
+struct GroupInfo {
+    uint64_t offset;
+    uint64_t rows;
+    int64_t first_time_ms;
+};
+
+static std::string footer(int n_columns, const std::vector<GroupInfo> &groups, const std::string &metadata) {
+    std::vector<uint8_t> data;
+    for (int c = 0; c < n_columns; c++) {
+        char name[32] = {};
+        strncpy(name, COLUMNS[c].name, sizeof(name) - 1);
+        put(data, name, sizeof(name));
+        put(data, static_cast<uint8_t>(COLUMNS[c].type));
+        const uint8_t reserved[3] = {};
+        put(data, reserved, 3);
+        put(data, COLUMNS[c].values_per_row);
+    }
+    put(data, static_cast<uint64_t>(groups.size()));
+    for (const GroupInfo &group : groups) {
+        put(data, group.offset);
+        put(data, group.rows);
+        put(data, group.first_time_ms);
+    }
+    put(data, static_cast<uint32_t>(metadata.size()));
+    put(data, metadata.data(), metadata.size());
+    put(data, static_cast<uint64_t>(data.size()));
+    put(data, MAGIC);
+    return std::string(data.begin(), data.end());
+}
+
+int main(int argc, char *argv[]) {
+    std::string output;
+    bool pixels = true;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--no-pixels") {
+            pixels = false;
+        } else {
+            collect(arg, paths);
+        }
+    }
+    if (output.empty() || paths.empty()) {
+        fprintf(stderr, "Usage: recording_export [-j threads] [--no-pixels] -o out.tcol (file.tcr | folder)...\n");
+        return 1;
+    }
+    // Recording names are their start time, so this is time order within a folder tree
+    std::sort(paths.begin(), paths.end());
+
+    const steady_clock::time_point start = steady_clock::now();
+    std::vector<Source> sources;
+    std::vector<Unit> units;
+    for (const std::string &path : paths) {
+        Source source;
+        if (!open_source(path, source)) {
+            continue;
+        }
+        for (size_t b = 0; b < source.blocks.size(); b += GROUP_BLOCKS) {
+            units.push_back({sources.size(), b, std::min(GROUP_BLOCKS, source.blocks.size() - b)});
+        }
+        sources.push_back(std::move(source));
+    }
+
+    FILE *file = fopen(output.c_str(), "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Unable to create %s\n", output.c_str());
+        return 1;
+    }
+    const int n_columns = pixels ? N_COLUMNS : COLUMN_TEMPERATURES;
+    uint8_t header[16] = {};
+    memcpy(header, &MAGIC, 4);
+    memcpy(header + 4, &VERSION, 2);
+    const uint16_t column_count = static_cast<uint16_t>(n_columns);
+    memcpy(header + 6, &column_count, 2);
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    uint64_t offset = sizeof(header);
+
+    // Workers convert the units in any order, at most GROUPS_AHEAD per thread beyond the one being written
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<size_t, RowGroup> converted;
+    size_t written = 0;
+    std::atomic<size_t> next_unit{0};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&]() {
+            for (size_t u = next_unit++; u < units.size(); u = next_unit++) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() { return u < written + threads * GROUPS_AHEAD; });
+                }
+                RowGroup group;
+                convert_unit(units[u], sources[units[u].source], pixels, group);
+                std::lock_guard<std::mutex> lock(mutex);
+                converted[u] = std::move(group);
+                changed.notify_all();
+            }
+        });
+    }
+
+    std::vector<GroupInfo> groups;
+    uint64_t rows = 0;
+    for (size_t u = 0; u < units.size(); u++) {
+        RowGroup group;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return converted.count(u) > 0; });
+            group = std::move(converted[u]);
+            converted.erase(u);
+        }
+        if (ok && group.rows > 0) {
+            groups.push_back({offset, group.rows, group.first_time_ms});
+            for (int c = 0; c < n_columns; c++) {
+                ok = ok && fwrite(group.columns[c].data(), 1, group.columns[c].size(), file) ==
+                           group.columns[c].size();
+                offset += group.columns[c].size();
+            }
+            rows += group.rows;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        written++;
+        changed.notify_all();
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    std::string metadata = "created_ms=" + std::to_string(
+            duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count()) +
+            "\nambient_offset=" + std::to_string(AMBIENT_OFFSET) + "\n";
+    for (size_t s = 0; s < sources.size(); s++) {
+        metadata += "file." + std::to_string(s) + "=" + sources[s].path + "\n" + "emissivity." + std::to_string(s) +
+                    "=" + std::to_string(sources[s].emissivity) + "\n";
+    }
+    const std::string tail = footer(n_columns, groups, metadata);
+    ok = ok && fwrite(tail.data(), 1, tail.size(), file) == tail.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Unable to write %s\n", output.c_str());
+        return 1;
+    }
+    const double seconds = duration<double>(steady_clock::now() - start).count();
+    printf("%s: %zu recordings, %llu frames in %zu row groups, %.1f MB, %.2f s (%.0f frames/s, %zu threads)\n",
+           output.c_str(), sources.size(), static_cast<unsigned long long>(rows), groups.size(),
+           (offset + tail.size()) / 1e6, seconds, rows / seconds, threads);
+    return 0;
+}
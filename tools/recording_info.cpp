@@ -0,0 +1,164 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+// Reports on continuous recordings (.tcr): frames, duration, compression ratio and decode throughput; with
+// --bench also the encode and write throughput of the recorder on the same frames, written next to the input.
+//
+//   recording_info [--bench] file.tcr...
+//   recording_info --synthetic <frames> file.tcr    (simulated chess mode session, to benchmark a card)
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Recording.h"
+
+using namespace std::chrono;
+
+static bool write_recording(const std::string &path, const uint16_t *eeprom, int fps,
+                            const std::vector<RecordedFrame> &frames, double &seconds) {
+    const steady_clock::time_point start = steady_clock::now();
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    std::string data = recording::encode_header(eeprom, fps, 0.99f, frames.empty() ? 0 : frames.front().time_ms);
+    bool ok = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    uint64_t offset = data.size();
+    std::vector<RecordingBlockInfo> index;
+    std::vector<RecordedFrame> block_frames;
+    std::vector<uint8_t> scratch;
+    for (size_t i = 0; ok && i < frames.size(); i += recording::KEYFRAME_INTERVAL) {
+        block_frames.assign(frames.begin() + i,
+                            frames.begin() + std::min(frames.size(), i + recording::KEYFRAME_INTERVAL));
+        size_t raw_size;
+        ok = recording::encode_block(block_frames, data, scratch, raw_size) &&
+             write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+        index.push_back({block_frames.front().frame_no, block_frames.front().time_ms, offset,
+                         static_cast<uint32_t>(block_frames.size())});
+        offset += data.size();
+    }
+    data = recording::encode_index(index, offset);
+    ok = ok && write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) && fdatasync(fd) == 0;
+    close(fd);
+    seconds = duration<double>(steady_clock::now() - start).count();
+    return ok;
+}
+
+// Chess mode: each frame updates the pixels of one subpage (ADC noise around a per pixel offset plus a slowly
+// moving warm object); the pixels of the other subpage keep their previous values.
+static std::vector<RecordedFrame> synthetic_frames(size_t count, uint16_t *eeprom) {
+    std::mt19937 random(42);
+    std::normal_distribution<double> noise(0.0, 6.0);
+    std::uniform_int_distribution<int> offset(-250, 250);
+    std::vector<int> offsets(768);
+    for (int &o : offsets) {
+        o = offset(random);
+    }
+    for (size_t i = 0; i < RECORDING_EEPROM_WORDS; i++) {
+        eeprom[i] = static_cast<uint16_t>(random());
+    }
+    std::vector<RecordedFrame> frames(count);
+    RecordedFrame current = {};
+    const int64_t start_ms = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    for (size_t f = 0; f < count; f++) {
+        const uint16_t subpage = f % 2;
+        const double object_x = 12 + 8 * std::sin(f / 200.0);
+        for (int i = 0; i < 768; i++) {
+            const int row = i / 32, column = i % 32;
+            if (((row + column) % 2) != subpage) {
+                continue;
+            }
+            const double distance = std::hypot(column - object_x, row - 12.0);
+            const double signal = distance < 6 ? 400.0 : 0.0;
+            current.words[i] = static_cast<uint16_t>(static_cast<int16_t>(offsets[i] + signal + noise(random)));
+        }
+        for (size_t i = 768; i < 832; i++) {
+            current.words[i] = static_cast<uint16_t>(0x4000 + i + static_cast<int>(noise(random) / 3));
+        }
+        current.words[832] = 0x1901;
+        current.words[833] = subpage;
+        current.frame_no = f + 1;
+        current.time_ms = start_ms + static_cast<int64_t>(f) * 250 + static_cast<int64_t>(std::abs(noise(random)));
+        frames[f] = current;
+    }
+    return frames;
+}
+
+int main(int argc, char *argv[]) {
+    bool bench = false;
+    int first = 1;
+    if (argc > 3 && std::string(argv[1]) == "--synthetic") {
+        uint16_t eeprom[RECORDING_EEPROM_WORDS];
+        const std::vector<RecordedFrame> frames = synthetic_frames(std::strtoul(argv[2], nullptr, 10), eeprom);
+        double seconds;
+        if (!write_recording(argv[3], eeprom, 4, frames, seconds)) {
+            fprintf(stderr, "Unable to write %s\n", argv[3]);
+            return 1;
+        }
+        printf("%s: %zu simulated frames written in %.2f s\n", argv[3], frames.size(), seconds);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        bench = true;
+        first = 2;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "Usage: recording_info [--bench] file.tcr... | --synthetic <frames> file.tcr\n");
+        return 1;
+    }
+    for (int i = first; i < argc; i++) {
+        const std::string path = argv[i];
+        RecordingReader reader;
+        if (!reader.open(path)) {
+            fprintf(stderr, "%s: not a recording\n", path.c_str());
+            continue;
+        }
+        std::vector<RecordedFrame> frames;
+        RecordedFrame frame;
+        const steady_clock::time_point start = steady_clock::now();
+        while (reader.next(frame)) {
+            frames.push_back(frame);
+        }
+        const double decode_s = duration<double>(steady_clock::now() - start).count();
+        FILE *file = fopen(path.c_str(), "rb");
+        fseeko(file, 0, SEEK_END);
+        const double stored = static_cast<double>(ftello(file));
+        fclose(file);
+        const double raw = static_cast<double>(frames.size()) * RECORDING_FRAME_WORDS * 2;
+        const double minutes = frames.size() < 2 ? 0 : (frames.back().time_ms - frames.front().time_ms) / 60000.0;
+        printf("%s: %zu blocks, %zu frames, %.1f min, %.2f MB stored, %.2f MB raw, compression %.2f:1, "
+               "%.1f bytes/frame, decode %.1f MB/s\n", path.c_str(), reader.blocks().size(), frames.size(), minutes,
+               stored / 1e6, raw / 1e6, stored > 0 ? raw / stored : 0, frames.empty() ? 0 : stored / frames.size(),
+               decode_s > 0 ? raw / 1e6 / decode_s : 0);
+        if (bench && !frames.empty()) {
+            const std::string bench_path = path + ".bench";
+            double write_s;
+            if (write_recording(bench_path, reader.eeprom(), reader.fps(), frames, write_s)) {
+                printf("  encode and write: %.1f MB/s of raw frames, %.0f frames/s (the sensor produces %d)\n",
+                       raw / 1e6 / write_s, frames.size() / write_s, reader.fps());
+            }
+            unlink(bench_path.c_str());
+        }
+    }
+    return 0;
+}
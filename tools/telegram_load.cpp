@@ -0,0 +1,126 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+// Load generator for the bot: simulated staff members issue commands through telegram_mock and wait for the
+// bot's first reply before thinking and sending the next one (closed loop).
+//
+//   telegram_load [--url http://127.0.0.1:8081] [--users 20] [--duration 30] [--think-ms 200]
+//                 [--commands /alertahoy,/alertault,/tiempo,cb:button4]
+//
+// Commands prefixed with cb: are sent as inline button presses. Prints command throughput and reply latency
+// percentiles, then the mock's own statistics (which include alerts sent by the dispatcher).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mock_http.h"
+
+using namespace std::chrono;
+
+int main(int argc, char *argv[]) {
+    std::string url = "http://127.0.0.1:8081";
+    int users = 20;
+    int duration_s = 30;
+    int think_ms = 200;
+    std::string command_list = "/alertahoy,/alertault,/tiempo,cb:button4";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if (option == "--url") {
+            url = argv[i + 1];
+        } else if (option == "--users") {
+            users = std::max(1, std::atoi(argv[i + 1]));
+        } else if (option == "--duration") {
+            duration_s = std::atoi(argv[i + 1]);
+        } else if (option == "--think-ms") {
+            think_ms = std::atoi(argv[i + 1]);
+        } else if (option == "--commands") {
+            command_list = argv[i + 1];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    // http://host:port
+    const std::string authority = url.substr(url.find("://") == std::string::npos ? 0 : url.find("://") + 3);
+    const std::string host = authority.substr(0, authority.find(':'));
+    const std::string port = authority.find(':') == std::string::npos ? "80" : authority.substr(authority.find(':') + 1);
+    std::vector<std::string> commands;
+    std::stringstream ss(command_list);
+    std::string command;
+    while (std::getline(ss, command, ',')) {
+        commands.push_back(command);
+    }
+
+    std::mutex mutex;
+    std::vector<double> latencies;
+    size_t timeouts = 0;
+    size_t failures = 0;
+    const auto start = steady_clock::now();
+    const auto end = start + seconds(duration_s);
+    std::vector<std::thread> threads;
+    for (int user = 0; user < users; user++) {
+        threads.emplace_back([&, user]() {
+            const std::string chat = std::to_string(100000 + user);
+            for (size_t n = static_cast<size_t>(user); steady_clock::now() < end; n++) {
+                const std::string &next = commands[n % commands.size()];
+                const std::string body = "chat=" + chat + "&wait=1&" +
+                                         (next.rfind("cb:", 0) == 0 ? "data=" + mock_http::url_encode(next.substr(3))
+                                                                    : "text=" + mock_http::url_encode(next));
+                std::string response;
+                const int status = mock_http::request(host, port, "POST", "/mock/update", body, response);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (status != 200) {
+                        failures++;
+                    } else if (response.find("\"answered\":true") == std::string::npos) {
+                        timeouts++;
+                    } else {
+                        const size_t pos = response.find("\"latency_ms\":");
+                        latencies.push_back(std::atof(response.c_str() + pos + 13));
+                    }
+                }
+                if (status != 200) {
+                    std::this_thread::sleep_for(seconds(1));
+                }
+                std::this_thread::sleep_for(milliseconds(think_ms));
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    const double elapsed_s = duration<double>(steady_clock::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1,
+                                                            static_cast<size_t>(p * latencies.size()))];
+    };
+    printf("users %d, %.1f s: %zu commands answered (%.1f/s), %zu unanswered, %zu failed requests\n", users,
+           elapsed_s, latencies.size(), latencies.size() / elapsed_s, timeouts, failures);
+    printf("reply latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", percentile(0.5), percentile(0.9),
+           percentile(0.99), latencies.empty() ? 0.0 : latencies.back());
+    std::string stats;
+    if (mock_http::request(host, port, "GET", "/mock/stats", "", stats) == 200) {
+        printf("mock: %s\n", stats.c_str());
+    }
+    return latencies.empty() ? 1 : 0;
+}
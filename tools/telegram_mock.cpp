@@ -0,0 +1,362 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+Modified 2023 Diego Vilchez Villalobos
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+// Local stand-in for the subset of the Telegram Bot API used by ThermalCamera::runbot() and AlertDispatcher, to
+// measure alert delivery and bot command throughput without the real service.
+//
+//   telegram_mock [--port 8081] [--latency-ms 0] [--jitter-ms 0] [--error-rate 0] [--error-code 500]
+//
+// Point the application at it with THERMALCAM_TELEGRAM_URL=http://127.0.0.1:8081 (needs the curl HTTP client,
+// the Boost client only speaks HTTPS).
+//
+// Bot API:  getMe, getUpdates (long polling), sendMessage, sendPhoto, sendDocument, sendMediaGroup,
+//           answerCallbackQuery. Latency and injected errors apply to the send* methods.
+// Control:  POST /mock/update   chat=<id>&text=</cmd> or chat=<id>&data=<callback>[&wait=1]
+//                               Queues an update for the bot. With wait=1 the request returns once the bot
+//                               sent its first reply to that chat: {"update_id":N,"latency_ms":X}.
+//           GET  /mock/stats    Request counts, injected errors, sends to chats that never issued a command
+//                               (the alerts) and reply latency.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include "mock_http.h"
+
+using namespace std::chrono;
+
+struct Config {
+    int port = 8081;
+    int latency_ms = 0;
+    int jitter_ms = 0;
+    double error_rate = 0.0;
+    int error_code = 500;
+};
+
+struct Update {
+    long id;
+    long long chat;
+    std::string json;
+    steady_clock::time_point queued;
+    // When getUpdates handed it to the bot
+    bool delivered = false;
+    steady_clock::time_point delivered_time;
+    bool answered = false;
+    double latency_ms = 0;
+};
+
+static std::string json_escape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c == '\n' ? ' ' : c;
+    }
+    return out;
+}
+
+class MockServer {
+
+public:
+    explicit MockServer(const Config &_config) : config(_config), next_update_id(1), next_message_id(1),
+                                                 random(std::random_device()()) {
+        start = steady_clock::now();
+    }
+
+    void serve(int fd) {
+        std::string buffer;
+        mock_http::Request request;
+        while (mock_http::read_request(fd, buffer, request)) {
+            int status = 200;
+            const std::string body = handle(request, status);
+            if (!mock_http::write_response(fd, status, body, request.keep_alive) || !request.keep_alive) {
+                break;
+            }
+        }
+        close(fd);
+    }
+
+private:
+    const Config config;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<Update>> updates;
+    // Updates not answered yet, per chat and in order
+    std::map<long long, std::deque<std::shared_ptr<Update>>> pending;
+    long next_update_id;
+    long next_message_id;
+    std::map<std::string, size_t> requests;
+    size_t errors_injected = 0;
+    // Sends to chats that never issued a command: the alerts of the dispatcher
+    size_t alert_sends = 0;
+    std::map<long long, bool> user_chats;
+    size_t bytes_received = 0;
+    std::vector<double> latencies;
+    std::mt19937 random;
+    steady_clock::time_point start;
+
+    std::string handle(const mock_http::Request &request, int &status) {
+        const steady_clock::time_point arrived = steady_clock::now();
+        const auto params = mock_http::parameters(request);
+        auto param = [&params](const std::string &name) {
+            auto it = params.find(name);
+            return it == params.end() ? std::string() : it->second;
+        };
+        if (request.path == "/mock/update") {
+            return queue_update(param("chat"), param("text"), param("data"), param("wait") == "1");
+        }
+        if (request.path == "/mock/stats") {
+            return stats();
+        }
+        // /bot<token>/<method>
+        const std::string method = request.path.substr(request.path.rfind('/') + 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests[method]++;
+            bytes_received += request.body.size();
+        }
+        if (method == "getMe") {
+            return R"({"ok":true,"result":{"id":1,"is_bot":true,"first_name":"Mock","username":"thermalcam_mock_bot"}})";
+        }
+        if (method == "getUpdates") {
+            return get_updates(std::atol(param("offset").c_str()), std::atoi(param("timeout").c_str()),
+                               std::max(1, param("limit").empty() ? 100 : std::atoi(param("limit").c_str())));
+        }
+        if (method.rfind("send", 0) == 0 || method == "answerCallbackQuery") {
+            if (!simulate_send(status)) {
+                return R"({"ok":false,"error_code":)" + std::to_string(status) +
+                       (status == 429 ? R"(,"description":"Too Many Requests: retry after 1","parameters":{"retry_after":1}})"
+                                      : R"(,"description":"Injected error"})");
+            }
+            if (method == "answerCallbackQuery") {
+                return R"({"ok":true,"result":true})";
+            }
+            const long long chat = std::atoll(param("chat_id").c_str());
+            replied(chat, arrived);
+            if (method == "sendMediaGroup") {
+                // One message per media item
+                const std::string media = param("media");
+                size_t items = 0;
+                for (size_t pos = media.find("\"media\""); pos != std::string::npos; pos = media.find("\"media\"", pos + 1)) {
+                    items++;
+                }
+                std::string result;
+                for (size_t i = 0; i < std::max<size_t>(items, 1); i++) {
+                    result += (i ? "," : "") + message_json(chat, "photo");
+                }
+                return R"({"ok":true,"result":[)" + result + "]}";
+            }
+            return R"({"ok":true,"result":)" + message_json(chat, method == "sendPhoto" ? "photo" :
+                                                                   method == "sendDocument" ? "document" : "text") + "}";
+        }
+        status = 404;
+        return R"({"ok":false,"error_code":404,"description":"Not Found: method not implemented by the mock"})";
+    }
+
+    // Apply the configured latency, then decide whether this request fails.
+    bool simulate_send(int &status) {
+        int delay_ms;
+        bool fail;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::uniform_int_distribution<int> jitter(0, std::max(0, config.jitter_ms));
+            delay_ms = config.latency_ms + jitter(random);
+            fail = std::uniform_real_distribution<double>(0, 1)(random) < config.error_rate;
+            errors_injected += fail ? 1 : 0;
+        }
+        std::this_thread::sleep_for(milliseconds(delay_ms));
+        if (fail) {
+            status = config.error_code;
+        }
+        return !fail;
+    }
+
+    std::string message_json(long long chat, const std::string &kind) {
+        long id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = next_message_id++;
+        }
+        const std::string ids = std::to_string(id);
+        std::string json = R"({"message_id":)" + ids + R"(,"from":{"id":1,"is_bot":true,"first_name":"Mock"},)" +
+                           R"("chat":{"id":)" + std::to_string(chat) + R"(,"type":"private"},"date":)" +
+                           std::to_string(time(nullptr));
+        if (kind == "photo") {
+            json += R"(,"photo":[{"file_id":"mock_)" + ids + R"(_s","file_unique_id":"u)" + ids +
+                    R"(s","width":96,"height":160},{"file_id":"mock_)" + ids + R"(","file_unique_id":"u)" + ids +
+                    R"(","width":240,"height":400}])";
+        } else if (kind == "document") {
+            json += R"(,"document":{"file_id":"mock_doc_)" + ids + R"(","file_unique_id":"d)" + ids + R"("})";
+        } else {
+            json += R"(,"text":"ok")";
+        }
+        return json + "}";
+    }
+
+    // The first send to a chat that was requested after the bot received an update answers that update. Sends
+    // requested earlier are the rest of the reply to a previous update.
+    void replied(long long chat, steady_clock::time_point arrived) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (user_chats.count(chat) == 0) {
+            alert_sends++;
+            return;
+        }
+        auto it = pending.find(chat);
+        if (it == pending.end() || it->second.empty() || !it->second.front()->delivered ||
+            arrived < it->second.front()->delivered_time) {
+            return;
+        }
+        std::shared_ptr<Update> update = it->second.front();
+        it->second.pop_front();
+        update->answered = true;
+        update->latency_ms = duration<double, std::milli>(steady_clock::now() - update->queued).count();
+        latencies.push_back(update->latency_ms);
+        cv.notify_all();
+    }
+
+    std::string queue_update(const std::string &chat_text, const std::string &text, const std::string &data,
+                             bool wait) {
+        const long long chat = std::atoll(chat_text.c_str());
+        std::shared_ptr<Update> update = std::make_shared<Update>();
+        std::unique_lock<std::mutex> lock(mutex);
+        update->id = next_update_id++;
+        update->chat = chat;
+        const std::string ids = std::to_string(update->id);
+        const std::string user = R"({"id":)" + std::to_string(chat) + R"(,"is_bot":false,"first_name":"Usuario"})";
+        const std::string chat_json = R"({"id":)" + std::to_string(chat) + R"(,"type":"private"})";
+        const std::string date = std::to_string(time(nullptr));
+        if (data.empty()) {
+            const size_t command_length = std::min(text.find(' '), text.size());
+            update->json = R"({"update_id":)" + ids + R"(,"message":{"message_id":)" + ids + R"(,"from":)" + user +
+                           R"(,"chat":)" + chat_json + R"(,"date":)" + date + R"(,"text":")" + json_escape(text) + R"(")" +
+                           (text.rfind('/', 0) == 0 ? R"(,"entities":[{"offset":0,"length":)" +
+                                                      std::to_string(command_length) + R"(,"type":"bot_command"}])"
+                                                    : "") + "}}";
+        } else {
+            update->json = R"({"update_id":)" + ids + R"(,"callback_query":{"id":"cq)" + ids + R"(","from":)" +
+                           user + R"(,"message":{"message_id":)" + ids + R"(,"chat":)" + chat_json + R"(,"date":)" +
+                           date + R"(,"text":"menu"},"chat_instance":"1","data":")" + json_escape(data) + R"("}})";
+        }
+        update->queued = steady_clock::now();
+        updates.push_back(update);
+        pending[chat].push_back(update);
+        user_chats[chat] = true;
+        cv.notify_all();
+        if (wait) {
+            cv.wait_for(lock, seconds(60), [&update] { return update->answered; });
+        }
+        return R"({"update_id":)" + ids + R"(,"answered":)" + (update->answered ? "true" : "false") +
+               R"(,"latency_ms":)" + std::to_string(update->latency_ms) + "}";
+    }
+
+    std::string get_updates(long offset, int timeout_s, int limit) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Updates below the offset were confirmed by the bot
+        while (!updates.empty() && updates.front()->id < offset) {
+            updates.pop_front();
+        }
+        cv.wait_for(lock, seconds(std::max(0, timeout_s)), [this] { return !updates.empty(); });
+        std::string result;
+        int n = 0;
+        const steady_clock::time_point now = steady_clock::now();
+        for (const auto &update : updates) {
+            if (n++ == limit) {
+                break;
+            }
+            if (!update->delivered) {
+                update->delivered = true;
+                update->delivered_time = now;
+            }
+            result += (result.empty() ? "" : ",") + update->json;
+        }
+        return R"({"ok":true,"result":[)" + result + "]}";
+    }
+
+    std::string stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string counts;
+        for (const auto &r : requests) {
+            counts += (counts.empty() ? "" : ",") + ("\"" + r.first + "\":" + std::to_string(r.second));
+        }
+        std::vector<double> sorted = latencies;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) {
+            return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+        };
+        const double elapsed_s = duration<double>(steady_clock::now() - start).count();
+        return R"({"uptime_s":)" + std::to_string(elapsed_s) + R"(,"requests":{)" + counts + "}" +
+               R"(,"bytes_received":)" + std::to_string(bytes_received) +
+               R"(,"errors_injected":)" + std::to_string(errors_injected) +
+               R"(,"alert_sends":)" + std::to_string(alert_sends) +
+               R"(,"updates_answered":)" + std::to_string(sorted.size()) +
+               R"(,"reply_latency_ms":{"p50":)" + std::to_string(percentile(0.5)) +
+               R"(,"p90":)" + std::to_string(percentile(0.9)) + R"(,"p99":)" + std::to_string(percentile(0.99)) +
+               R"(,"max":)" + std::to_string(sorted.empty() ? 0.0 : sorted.back()) + "}}";
+    }
+};
+
+int main(int argc, char *argv[]) {
+    Config config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string option = argv[i];
+        if (option == "--port") {
+            config.port = std::atoi(argv[i + 1]);
+        } else if (option == "--latency-ms") {
+            config.latency_ms = std::atoi(argv[i + 1]);
+        } else if (option == "--jitter-ms") {
+            config.jitter_ms = std::atoi(argv[i + 1]);
+        } else if (option == "--error-rate") {
+            config.error_rate = std::atof(argv[i + 1]);
+        } else if (option == "--error-code") {
+            config.error_code = std::atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", option.c_str());
+            return 1;
+        }
+    }
+    const int server = socket(AF_INET, SOCK_STREAM, 0);
+    const int yes = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(config.port));
+    if (bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(server, 128) != 0) {
+        perror("telegram_mock");
+        return 1;
+    }
+    printf("Telegram mock on http://127.0.0.1:%d (latency %d+%d ms, error rate %.2f, error code %d)\n", config.port,
+           config.latency_ms, config.jitter_ms, config.error_rate, config.error_code);
+    fflush(stdout);
+    MockServer mock(config);
+    while (true) {
+        const int fd = accept(server, nullptr, nullptr);
+        if (fd >= 0) {
+            std::thread(&MockServer::serve, &mock, fd).detach();
+        }
+    }
+}